@@ -1,6 +1,10 @@
 
 #include <iostream>
 #include <string>
+#include <memory>
+#include <algorithm>
+
+#include <boost/algorithm/string.hpp>
 
 #include <boost/gil.hpp>
 #include <boost/gil/extension/io/png.hpp>
@@ -13,12 +17,141 @@ namespace gil = boost::gil;
 
 namespace po = boost::program_options;
 
+#include "chroma_core.h"
+#include "frame_ring.hpp"
 #include "image.hpp"
 #include "matrix.hpp"
 
 
 using namespace std;
 
+// estimates the key color of a frame into ctx and key_color, refusing
+// estimates whose peak holds less than --key-min-confidence of the samples,
+// which are usually of the foreground rather than of the backing
+static bool estimate_key(po::variables_map& vm,
+                         chroma_ctx* ctx,
+                         gil::rgb8_pixel_t& key_color,
+                         const uint8_t* fg, size_t fg_stride,
+                         size_t width, size_t height)
+{
+  double confidence;
+  if(chroma_estimate_key_color(ctx, fg, fg_stride, width, height, vm["key-stride"].as<size_t>(), &confidence) != CHROMA_OK)
+    { cerr << "[ERROR] " << chroma_last_error(ctx) << endl; return false; }
+
+  chroma_get_key_color(ctx, &key_color[0], &key_color[1], &key_color[2]);
+  cout << "[INFO] Estimated key color: "
+       << (int) key_color[0] << " " << (int) key_color[1] << " " << (int) key_color[2]
+       << " (confidence " << confidence << ")" << endl;
+
+  if(confidence < vm["key-min-confidence"].as<double>()) {
+    cerr << "[ERROR] Key color estimate below the minimum confidence of "
+         << vm["key-min-confidence"].as<double>() << ", give --key-color R G B" << endl;
+    return false;
+  }
+  return true;
+}
+
+// keys the frames of the --ring-in frame ring as its stage 1, into the
+// --ring-out frame ring (as its stage 0) or in place, until the producer closes
+// the input ring. Pixels are only read from and written to ring slots.
+static int key_ring(po::variables_map& vm,
+                    gil::rgb8_pixel_t& key_color,
+                    bool auto_key,
+                    int despill,
+                    double threshold,
+                    string& output_mode)
+{
+  ring_lib::frame_ring in = ring_lib::frame_ring::attach(vm["ring-in"].as<string>());
+  size_t width = in.width(), height = in.height();
+
+  if(in.channels() != 3) { cerr << "[ERROR] Input ring frames must be rgb24" << endl; return 1; }
+
+  size_t out_channels = (output_mode == "composite") ? 3 : (output_mode == "matte" ? 1 : 4);
+  unique_ptr<ring_lib::frame_ring> out;
+  if(vm.count("ring-out")) {
+    out.reset(new ring_lib::frame_ring(ring_lib::frame_ring::attach(vm["ring-out"].as<string>())));
+    if(out->width() != width || out->height() != height || out->channels() != out_channels)
+      { cerr << "[ERROR] Output ring must hold " << width << "x" << height << "x" << out_channels << " frames" << endl; return 1; }
+  } else if(output_mode != "composite" || in.stages() < 3) {
+    cerr << "[ERROR] In place keying needs composite output and a 3 stage input ring" << endl;
+    return 1;
+  }
+
+  // the C API writes packed rows
+  ring_lib::frame_ring& dst_ring = out ? *out : in;
+  if(dst_ring.row_stride() != width * out_channels)
+    { cerr << "[ERROR] Keyed frames must have packed rows of " << width * out_channels << " bytes" << endl; return 1; }
+
+  gil::rgb8_image_t bg_resampled_image;
+  if(output_mode == "composite") {
+    string bg_file = vm["bg"].as<string>();
+    gil::rgb8_image_t bg_image;
+    image_lib::read_image(bg_image, bg_file);
+
+    // resample background once for every frame
+    bg_resampled_image.recreate(width, height);
+    gil::resize_view(gil::const_view(bg_image), gil::view(bg_resampled_image), gil::bilinear_sampler());
+  }
+  gil::rgb8c_view_t bg_view = gil::const_view(bg_resampled_image);
+
+  unique_ptr<chroma_ctx, void(*)(chroma_ctx*)> ctx(chroma_ctx_create(), chroma_ctx_destroy);
+  if(!ctx) { cerr << "[ERROR] Cannot create chroma context" << endl; return 1; }
+
+  chroma_set_key_color(ctx.get(), key_color[0], key_color[1], key_color[2]);
+  chroma_set_despill(ctx.get(), despill);
+  chroma_set_threshold(ctx.get(), threshold);
+
+  size_t frames = 0;
+  bool key_found = true;
+  int status = CHROMA_OK;
+  ring_lib::frame_slot_header* in_slot;
+  ring_lib::frame_slot_header* out_slot;
+
+  while(uint8_t* fg = in.acquire(1, in_slot)) {
+
+    // key color of the first frame is used for the whole stream
+    if(auto_key && frames == 0) {
+      if(!estimate_key(vm, ctx.get(), key_color, fg, in.row_stride(), width, height))
+        { key_found = false; break; }
+    }
+
+    status = chroma_compute_distance(ctx.get(), fg, in.row_stride(), width, height);
+    if(status != CHROMA_OK) break;
+
+    uint8_t* dst = fg;
+    if(out) {
+      dst = out->acquire(0, out_slot);
+      if(!dst) break; // downstream is gone
+      *out_slot = *in_slot;
+    }
+
+    if(output_mode == "composite")
+      status = chroma_composite(ctx.get(),
+                                fg, in.row_stride(),
+                                gil::interleaved_view_get_raw_data(bg_view), bg_view.pixels().row_size(),
+                                dst, width, height);
+    else if(output_mode == "matte")
+      status = chroma_matte(ctx.get(), dst, width, height);
+    else
+      status = chroma_matte_rgba(ctx.get(), fg, in.row_stride(), dst, width, height);
+
+    if(out) out->release(0);
+    in.release(1);
+    if(status != CHROMA_OK) break;
+
+    frames++;
+  }
+
+  if(out) out->close(0);
+  in.close(1);
+
+  if(!key_found) return 1;
+  if(status != CHROMA_OK) { cerr << "[ERROR] " << chroma_last_error(ctx.get()) << endl; return 1; }
+
+  cout << "[INFO] Keyed " << frames << " frames" << endl;
+  return 0;
+}
+
 int main(int argc, char const *argv[]) {
 
   try
@@ -30,11 +163,19 @@ int main(int argc, char const *argv[]) {
                                  "Allowed options");
     desc.add_options()
       ("help", "produce help message")
-      ("fg", po::value<string>()->required(), "foreground image file (PNG)")
-      ("bg", po::value<string>()->required(), "background image file (PNG)")
+      ("fg", po::value<string>(), "foreground image file (PNG)")
+      ("bg", po::value<string>(), "background image file (PNG), composite mode only")
       ("o", po::value<string>()->default_value("../output.png"), "output image file (PNG)")
-      ("key-color", po::value< vector<int> >()->multitoken()->required(), "key color (RGB)")
-      ("t", po::value<double>()->default_value(1), "threshold")
+      ("key-color", po::value< vector<string> >()->multitoken(), "key color (RGB) or 'auto'")
+      ("key-stride", po::value<size_t>()->default_value(16), "sampling stride of 'auto' key color")
+      ("key-min-confidence", po::value<double>()->default_value(0.15), "minimum confidence of 'auto' key color")
+      ("t", po::value<string>()->default_value("1"), "threshold, or comma separated thresholds to sweep")
+      ("output-mode", po::value<string>()->default_value("composite"), "output: composite, matte (8 bit alpha) or rgba (foreground + alpha)")
+      ("despill", po::value<string>()->default_value("none"), "key color spill suppression: none, average or max")
+      ("ring-in", po::value<string>(), "key the rgb24 frames of this shared memory frame ring instead of --fg")
+      ("ring-out", po::value<string>(), "shared memory frame ring receiving the keyed frames (in place if missing)")
+      ("save-dist", po::value<string>(), "save the distance map (16 bit PNG if *.png, raw otherwise)")
+      ("load-dist", po::value<string>(), "load a saved distance map instead of keying the foreground")
     ;
 
     po::variables_map vm;
@@ -45,12 +186,46 @@ int main(int argc, char const *argv[]) {
     po::notify(vm);
 
 
-    gil::rgb8_pixel_t key_color;
-    vector<int> key_color_vec;
-    if(!vm["key-color"].empty() && (key_color_vec = vm["key-color"].as<vector<int>>()).size() == 3 ) {
-      int red   = key_color_vec[0];
-      int green = key_color_vec[1];
-      int blue  = key_color_vec[2];
+    bool load_dist = vm.count("load-dist");
+
+    gil::rgb8_pixel_t key_color{0, 0, 0};
+    vector<string> key_color_vec;
+    if(vm.count("key-color")) key_color_vec = vm["key-color"].as<vector<string>>();
+    bool auto_key = (key_color_vec.size() == 1 && key_color_vec[0] == "auto");
+
+    int despill;
+    string despill_str = vm["despill"].as<string>();
+    if(despill_str == "none")         despill = CHROMA_DESPILL_NONE;
+    else if(despill_str == "average") despill = CHROMA_DESPILL_AVERAGE;
+    else if(despill_str == "max")     despill = CHROMA_DESPILL_MAX;
+    else { cerr << "[ERROR] Despill must be none, average or max" << endl; return 1; }
+
+    string output_mode = vm["output-mode"].as<string>();
+    if(output_mode != "composite" && output_mode != "matte" && output_mode != "rgba")
+      { cerr << "[ERROR] Output mode must be composite, matte or rgba" << endl; return 1; }
+
+    bool composite = (output_mode == "composite");
+    if(composite && !vm.count("bg"))
+      { cerr << "[ERROR] A background (--bg) is required in composite mode" << endl; return 1; }
+
+    // despill needs the key color even when the distance map is loaded
+
+    if(load_dist && key_color_vec.empty() && despill == CHROMA_DESPILL_NONE) {
+      // key color is baked into the distance map
+    } else if(auto_key) {
+      if(vm["key-stride"].as<size_t>() == 0)
+        { cerr << "[ERROR] Key stride must be greater than 0" << endl; return 1; }
+      if(vm["key-min-confidence"].as<double>() < 0 || vm["key-min-confidence"].as<double>() > 1)
+        { cerr << "[ERROR] Key minimum confidence must be in range 0 - 1" << endl; return 1; }
+    } else if(key_color_vec.size() == 3) {
+      int red, green, blue;
+      try {
+        red   = stoi(key_color_vec[0]);
+        green = stoi(key_color_vec[1]);
+        blue  = stoi(key_color_vec[2]);
+      } catch(logic_error&) {
+        cerr << "[ERROR] Color values must be integers or 'auto'" << endl; return 1;
+      }
 
       if((red   > 255   || red < 0) ||
          (green > 255 || green < 0) ||
@@ -63,31 +238,139 @@ int main(int argc, char const *argv[]) {
       return 1;
     }
 
-    double threshold = vm["t"].as<double>();
-    if(threshold < 0) cerr << "[ERROR] Threshold must be greater than 0" << endl;
+    vector<string> threshold_str;
+    vector<double> thresholds;
+    boost::split(threshold_str, vm["t"].as<string>(), boost::is_any_of(","));
+    for(string& t : threshold_str) {
+      boost::trim(t);
+      double threshold;
+      try { threshold = stod(t); }
+      catch(logic_error&) { cerr << "[ERROR] Threshold must be a number" << endl; return 1; }
+
+      if(threshold < 0) { cerr << "[ERROR] Threshold must be greater than 0" << endl; return 1; }
+
+      // a repeated threshold would overwrite its own output
+      if(find(thresholds.begin(), thresholds.end(), threshold) != thresholds.end())
+        { cerr << "[ERROR] Threshold " << t << " is repeated" << endl; return 1; }
+      thresholds.push_back(threshold);
+    }
+
+    if(vm.count("ring-in")) {
+      if(thresholds.size() != 1 || load_dist || vm.count("save-dist"))
+        { cerr << "[ERROR] Ring mode keys with a single threshold and no distance map files" << endl; return 1; }
+
+      return key_ring(vm, key_color, auto_key, despill, thresholds[0], output_mode);
+    }
+
+    if(!vm.count("fg")) { cerr << "[ERROR] A foreground (--fg) is required" << endl; return 1; }
 
     string fg_file = vm["fg"].as<string>();
     gil::rgb8_image_t fg_image;
     image_lib::read_image(fg_image, fg_file);
 
-    string bg_file = vm["bg"].as<string>();
-    gil::rgb8_image_t bg_image;
-    image_lib::read_image(bg_image, bg_file);
+    size_t width = fg_image.width(), height = fg_image.height();
 
-    gil::rgb8_image_t res(fg_image.width(), fg_image.height());
+    // matte and rgba modes never load the background
+    gil::rgb8_image_t bg_resampled_image;
+    if(composite) {
+      string bg_file = vm["bg"].as<string>();
+      gil::rgb8_image_t bg_image;
+      image_lib::read_image(bg_image, bg_file);
 
-    // resample background
-    gil::rgb8_image_t bg_resampled_image(fg_image.width(), fg_image.height());
-    gil::resize_view(gil::const_view(bg_image), gil::view(bg_resampled_image), gil::bilinear_sampler());
+      // resample background
+      bg_resampled_image.recreate(width, height);
+      gil::resize_view(gil::const_view(bg_image), gil::view(bg_resampled_image), gil::bilinear_sampler());
+    }
 
-    image_lib::chroma_keying(res,
-                             fg_image,
-                             bg_resampled_image,
-                             key_color,
-                             threshold);
+    unique_ptr<chroma_ctx, void(*)(chroma_ctx*)> ctx(chroma_ctx_create(), chroma_ctx_destroy);
+    if(!ctx) { cerr << "[ERROR] Cannot create chroma context" << endl; return 1; }
+
+    chroma_set_key_color(ctx.get(), key_color[0], key_color[1], key_color[2]);
+    chroma_set_despill(ctx.get(), despill);
+
+    gil::rgb8c_view_t fg_view = gil::const_view(fg_image);
+    gil::rgb8c_view_t bg_view = gil::const_view(bg_resampled_image);
+
+    if(auto_key) {
+      if(!estimate_key(vm, ctx.get(), key_color,
+                       gil::interleaved_view_get_raw_data(fg_view), fg_view.pixels().row_size(),
+                       width, height))
+        return 1;
+    }
+
+    // distance map, computed once for every threshold
+    int status;
+    if(load_dist) {
+      string dist_file = vm["load-dist"].as<string>();
+      gil::gray16_image_t dist_map;
+      image_lib::read_distance(dist_map, dist_file, width, height);
+      if((size_t) dist_map.width() != width || (size_t) dist_map.height() != height)
+        { cerr << "[ERROR] Distance map and foreground sizes differ" << endl; return 1; }
+
+      status = chroma_set_distance(ctx.get(),
+                                   (const uint16_t*) gil::interleaved_view_get_raw_data(gil::const_view(dist_map)),
+                                   width, height);
+    } else {
+      status = chroma_compute_distance(ctx.get(),
+                                       gil::interleaved_view_get_raw_data(fg_view), fg_view.pixels().row_size(),
+                                       width, height);
+    }
+    if(status != CHROMA_OK) { cerr << "[ERROR] " << chroma_last_error(ctx.get()) << endl; return 1; }
+
+    if(vm.count("save-dist")) {
+      string dist_file = vm["save-dist"].as<string>();
+      gil::gray16_image_t dist_map(width, height);
+      status = chroma_get_distance(ctx.get(),
+                                   (uint16_t*) gil::interleaved_view_get_raw_data(gil::view(dist_map)),
+                                   width, height);
+      if(status != CHROMA_OK) { cerr << "[ERROR] " << chroma_last_error(ctx.get()) << endl; return 1; }
+
+      image_lib::write_distance(dist_map, dist_file);
+    }
+
+    gil::rgb8_image_t res;
+    gil::gray8_image_t res_matte;
+    gil::rgba8_image_t res_rgba;
+    if(output_mode == "composite") res.recreate(width, height);
+    else if(output_mode == "matte") res_matte.recreate(width, height);
+    else res_rgba.recreate(width, height);
 
     string out = vm["o"].as<string>();
-    image_lib::write_image(res, out);
+    for(size_t i = 0; i < thresholds.size(); i++) {
+      chroma_set_threshold(ctx.get(), thresholds[i]);
+
+      if(output_mode == "composite")
+        status = chroma_composite(ctx.get(),
+                                  gil::interleaved_view_get_raw_data(fg_view), fg_view.pixels().row_size(),
+                                  gil::interleaved_view_get_raw_data(bg_view), bg_view.pixels().row_size(),
+                                  gil::interleaved_view_get_raw_data(gil::view(res)),
+                                  width, height);
+      else if(output_mode == "matte")
+        status = chroma_matte(ctx.get(),
+                              gil::interleaved_view_get_raw_data(gil::view(res_matte)),
+                              width, height);
+      else
+        status = chroma_matte_rgba(ctx.get(),
+                                   gil::interleaved_view_get_raw_data(fg_view), fg_view.pixels().row_size(),
+                                   (uint8_t*) gil::interleaved_view_get_raw_data(gil::view(res_rgba)),
+                                   width, height);
+      if(status != CHROMA_OK) { cerr << "[ERROR] " << chroma_last_error(ctx.get()) << endl; return 1; }
+
+      // one output per threshold when sweeping: <o>_t<threshold>.png
+      string out_file = out;
+      if(thresholds.size() > 1) {
+        size_t dot = out.rfind('.');
+        size_t slash = out.rfind('/');
+        if(dot == string::npos || (slash != string::npos && dot < slash)) dot = out.size();
+        out_file = out.substr(0, dot) + "_t" + threshold_str[i] + out.substr(dot);
+      }
+
+      if(output_mode == "composite") image_lib::write_image(res, out_file);
+      else if(output_mode == "matte") image_lib::write_image(res_matte, out_file);
+      else image_lib::write_image(res_rgba, out_file);
+    }
+
+    return 0;
 
   } catch(exception& e) {
     cerr << "[ERROR] " << e.what() << endl;
@@ -95,5 +378,5 @@ int main(int argc, char const *argv[]) {
     cerr << "Unknown exception!" << endl;
   }
 
-  return 0;
+  return 1;
 }
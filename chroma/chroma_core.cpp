@@ -0,0 +1,278 @@
+// chroma_core.cpp
+// Description: This is the implementation of the C interface of the chroma keying library
+
+#include <string>
+#include <new>
+#include <exception>
+#include <stdexcept>
+
+#include <boost/gil.hpp>
+
+namespace gil = boost::gil;
+
+#include "chroma_core.h"
+#include "image.hpp"
+#include "matrix.hpp"
+
+using namespace std;
+
+struct chroma_ctx {
+  gil::rgb8_pixel_t key_color{0, 255, 0};
+  double threshold = 1.0;
+  image_lib::despill_mode despill = image_lib::DESPILL_NONE;
+
+  // scratch buffers
+  mat_lib::matrix<double> hue;
+  mat_lib::matrix<double> saturation;
+  mat_lib::matrix<double> value;
+  mat_lib::matrix<double> distance;
+
+  string error;
+};
+
+chroma_ctx* chroma_ctx_create(void) { return new (nothrow) chroma_ctx; }
+
+void chroma_ctx_destroy(chroma_ctx* ctx) { delete ctx; }
+
+int chroma_set_key_color(chroma_ctx* ctx, uint8_t red, uint8_t green, uint8_t blue)
+{
+  if (!ctx) return CHROMA_INVALID_ARGUMENT;
+
+  ctx->key_color = gil::rgb8_pixel_t{red, green, blue};
+  ctx->error.clear();
+  return CHROMA_OK;
+}
+
+int chroma_set_threshold(chroma_ctx* ctx, double threshold)
+{
+  if (!ctx) return CHROMA_INVALID_ARGUMENT;
+
+  if (threshold < 0) {
+    ctx->error = "threshold must be greater than 0";
+    return CHROMA_INVALID_ARGUMENT;
+  }
+
+  ctx->threshold = threshold;
+  ctx->error.clear();
+  return CHROMA_OK;
+}
+
+int chroma_set_despill(chroma_ctx* ctx, int mode)
+{
+  if (!ctx) return CHROMA_INVALID_ARGUMENT;
+
+  switch (mode) {
+    case CHROMA_DESPILL_NONE:    ctx->despill = image_lib::DESPILL_NONE; break;
+    case CHROMA_DESPILL_AVERAGE: ctx->despill = image_lib::DESPILL_AVERAGE; break;
+    case CHROMA_DESPILL_MAX:     ctx->despill = image_lib::DESPILL_MAX; break;
+    default:
+      ctx->error = "unknown despill mode";
+      return CHROMA_INVALID_ARGUMENT;
+  }
+
+  ctx->error.clear();
+  return CHROMA_OK;
+}
+
+const char* chroma_last_error(const chroma_ctx* ctx) { return ctx ? ctx->error.c_str() : ""; }
+
+// runs f translating exceptions into status codes and ctx->error
+template<typename F>
+static int guard__(chroma_ctx* ctx, F f)
+{
+  try {
+    f();
+  } catch (bad_alloc& e) {
+    ctx->error = e.what();
+    return CHROMA_OUT_OF_MEMORY;
+  } catch (invalid_argument& e) {
+    ctx->error = e.what();
+    return CHROMA_INVALID_ARGUMENT;
+  } catch (exception& e) {
+    ctx->error = e.what();
+    return CHROMA_ERROR;
+  } catch (...) {
+    ctx->error = "unknown exception";
+    return CHROMA_ERROR;
+  }
+
+  ctx->error.clear();
+  return CHROMA_OK;
+}
+
+static bool check_rows__(chroma_ctx* ctx, const void* ptr, size_t stride, size_t w)
+{
+  if (!ptr || stride < 3*w) {
+    ctx->error = "null buffer or stride smaller than a row";
+    return false;
+  }
+  return true;
+}
+
+// non-owning view over a caller buffer
+static gil::rgb8c_view_t view__(const uint8_t* ptr, size_t stride, size_t w, size_t h)
+{
+  return gil::interleaved_view(w, h, (const gil::rgb8_pixel_t*) ptr, stride);
+}
+
+static gil::rgb8_view_t view__(uint8_t* ptr, size_t stride, size_t w, size_t h)
+{
+  return gil::interleaved_view(w, h, (gil::rgb8_pixel_t*) ptr, stride);
+}
+
+int chroma_estimate_key_color(chroma_ctx* ctx,
+                              const uint8_t* fg_ptr, size_t fg_stride,
+                              size_t w, size_t h,
+                              size_t stride,
+                              double* confidence)
+{
+  if (!ctx) return CHROMA_INVALID_ARGUMENT;
+
+  if (!check_rows__(ctx, fg_ptr, fg_stride, w)) return CHROMA_INVALID_ARGUMENT;
+
+  return guard__(ctx, [&]() {
+    gil::rgb8_pixel_t key_color;
+    double peak_share;
+    image_lib::estimate_key_color(key_color, peak_share, view__(fg_ptr, fg_stride, w, h), stride);
+
+    ctx->key_color = key_color;
+    if (confidence) *confidence = peak_share;
+  });
+}
+
+int chroma_get_key_color(const chroma_ctx* ctx, uint8_t* red, uint8_t* green, uint8_t* blue)
+{
+  if (!ctx || !red || !green || !blue) return CHROMA_INVALID_ARGUMENT;
+
+  *red = ctx->key_color[0];
+  *green = ctx->key_color[1];
+  *blue = ctx->key_color[2];
+  return CHROMA_OK;
+}
+
+int chroma_key_frame(chroma_ctx* ctx,
+                     const uint8_t* fg_ptr, size_t fg_stride,
+                     const uint8_t* bg_ptr, size_t bg_stride,
+                     uint8_t* out_ptr,
+                     size_t w, size_t h)
+{
+  if (!ctx) return CHROMA_INVALID_ARGUMENT;
+
+  if (!check_rows__(ctx, fg_ptr, fg_stride, w) ||
+      !check_rows__(ctx, bg_ptr, bg_stride, w) ||
+      !check_rows__(ctx, out_ptr, 3*w, w))
+    return CHROMA_INVALID_ARGUMENT;
+
+  return guard__(ctx, [&]() {
+    image_lib::chroma_keying(view__(out_ptr, 3*w, w, h),
+                             view__(fg_ptr, fg_stride, w, h),
+                             view__(bg_ptr, bg_stride, w, h),
+                             ctx->key_color, ctx->threshold, ctx->despill,
+                             ctx->hue, ctx->saturation, ctx->value, ctx->distance);
+  });
+}
+
+int chroma_compute_distance(chroma_ctx* ctx,
+                            const uint8_t* fg_ptr, size_t fg_stride,
+                            size_t w, size_t h)
+{
+  if (!ctx) return CHROMA_INVALID_ARGUMENT;
+
+  if (!check_rows__(ctx, fg_ptr, fg_stride, w)) return CHROMA_INVALID_ARGUMENT;
+
+  return guard__(ctx, [&]() {
+    image_lib::key_distance(ctx->distance,
+                            view__(fg_ptr, fg_stride, w, h),
+                            ctx->key_color,
+                            ctx->hue, ctx->saturation, ctx->value);
+  });
+}
+
+int chroma_composite(chroma_ctx* ctx,
+                     const uint8_t* fg_ptr, size_t fg_stride,
+                     const uint8_t* bg_ptr, size_t bg_stride,
+                     uint8_t* out_ptr,
+                     size_t w, size_t h)
+{
+  if (!ctx) return CHROMA_INVALID_ARGUMENT;
+
+  if (!check_rows__(ctx, fg_ptr, fg_stride, w) ||
+      !check_rows__(ctx, bg_ptr, bg_stride, w) ||
+      !check_rows__(ctx, out_ptr, 3*w, w))
+    return CHROMA_INVALID_ARGUMENT;
+
+  return guard__(ctx, [&]() {
+    image_lib::composite(view__(out_ptr, 3*w, w, h),
+                         view__(fg_ptr, fg_stride, w, h),
+                         view__(bg_ptr, bg_stride, w, h),
+                         ctx->distance, ctx->threshold,
+                         ctx->key_color, ctx->despill);
+  });
+}
+
+int chroma_matte(chroma_ctx* ctx, uint8_t* out_ptr, size_t w, size_t h)
+{
+  if (!ctx) return CHROMA_INVALID_ARGUMENT;
+
+  if (!out_ptr) {
+    ctx->error = "null buffer";
+    return CHROMA_INVALID_ARGUMENT;
+  }
+
+  return guard__(ctx, [&]() {
+    image_lib::matte(gil::interleaved_view(w, h, (gil::gray8_pixel_t*) out_ptr, w),
+                     ctx->distance, ctx->threshold);
+  });
+}
+
+int chroma_matte_rgba(chroma_ctx* ctx,
+                      const uint8_t* fg_ptr, size_t fg_stride,
+                      uint8_t* out_ptr,
+                      size_t w, size_t h)
+{
+  if (!ctx) return CHROMA_INVALID_ARGUMENT;
+
+  if (!check_rows__(ctx, fg_ptr, fg_stride, w)) return CHROMA_INVALID_ARGUMENT;
+
+  if (!out_ptr) {
+    ctx->error = "null buffer";
+    return CHROMA_INVALID_ARGUMENT;
+  }
+
+  return guard__(ctx, [&]() {
+    image_lib::matte_rgba(gil::interleaved_view(w, h, (gil::rgba8_pixel_t*) out_ptr, 4*w),
+                          view__(fg_ptr, fg_stride, w, h),
+                          ctx->distance, ctx->threshold,
+                          ctx->key_color, ctx->despill);
+  });
+}
+
+int chroma_get_distance(chroma_ctx* ctx, uint16_t* map_ptr, size_t w, size_t h)
+{
+  if (!ctx) return CHROMA_INVALID_ARGUMENT;
+
+  if (!map_ptr) {
+    ctx->error = "null buffer";
+    return CHROMA_INVALID_ARGUMENT;
+  }
+
+  return guard__(ctx, [&]() {
+    image_lib::quantize_distance(gil::interleaved_view(w, h, (gil::gray16_pixel_t*) map_ptr, 2*w),
+                                 ctx->distance);
+  });
+}
+
+int chroma_set_distance(chroma_ctx* ctx, const uint16_t* map_ptr, size_t w, size_t h)
+{
+  if (!ctx) return CHROMA_INVALID_ARGUMENT;
+
+  if (!map_ptr) {
+    ctx->error = "null buffer";
+    return CHROMA_INVALID_ARGUMENT;
+  }
+
+  return guard__(ctx, [&]() {
+    image_lib::dequantize_distance(ctx->distance,
+                                   gil::interleaved_view(w, h, (const gil::gray16_pixel_t*) map_ptr, 2*w));
+  });
+}
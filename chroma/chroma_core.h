@@ -0,0 +1,112 @@
+// chroma_core.h
+// Description: This is the C interface of the chroma keying library. It keys
+// caller-owned packed rgb24 buffers in-process, without any file I/O.
+
+#ifndef CHROMA_CORE_H
+#define CHROMA_CORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// exported by the shared library, everything else is hidden
+#if defined(__GNUC__)
+#define CHROMA_API __attribute__((visibility("default")))
+#else
+#define CHROMA_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  // status codes
+
+  #define CHROMA_OK               0
+  #define CHROMA_INVALID_ARGUMENT 1
+  #define CHROMA_OUT_OF_MEMORY    2
+  #define CHROMA_ERROR            3
+
+  // spill suppression modes: the key dominant channel of foreground pixels
+  // is limited to the average or to the max of the other two channels
+
+  #define CHROMA_DESPILL_NONE    0
+  #define CHROMA_DESPILL_AVERAGE 1
+  #define CHROMA_DESPILL_MAX     2
+
+  // keying context: key color, threshold, despill mode and the scratch buffers reused
+  // between frames of the same size
+
+  typedef struct chroma_ctx chroma_ctx;
+
+  CHROMA_API chroma_ctx* chroma_ctx_create(void);
+
+  CHROMA_API void chroma_ctx_destroy(chroma_ctx* ctx);
+
+  CHROMA_API int chroma_set_key_color(chroma_ctx* ctx, uint8_t red, uint8_t green, uint8_t blue);
+
+  CHROMA_API int chroma_set_threshold(chroma_ctx* ctx, double threshold);
+
+  // CHROMA_DESPILL_NONE by default
+  CHROMA_API int chroma_set_despill(chroma_ctx* ctx, int mode);
+
+  // message of the last failing call on ctx ("" if none)
+  CHROMA_API const char* chroma_last_error(const chroma_ctx* ctx);
+
+  // estimates the key color of a w x h rgb24 frame from the hue / saturation
+  // histogram of its border and interior, sampled every stride pixels, and
+  // makes it the key color of ctx. confidence (if not NULL) receives the share
+  // of the samples in the histogram peak, low values meaning the estimate is
+  // likely a foreground color
+  CHROMA_API int chroma_estimate_key_color(chroma_ctx* ctx,
+                                           const uint8_t* fg_ptr, size_t fg_stride,
+                                           size_t w, size_t h,
+                                           size_t stride,
+                                           double* confidence);
+
+  CHROMA_API int chroma_get_key_color(const chroma_ctx* ctx, uint8_t* red, uint8_t* green, uint8_t* blue);
+
+  // keys one w x h frame. fg, bg and out are rgb24 rows, fg and bg rows being
+  // fg_stride / bg_stride bytes apart and out rows packed (3*w bytes)
+  CHROMA_API int chroma_key_frame(chroma_ctx* ctx,
+                                  const uint8_t* fg_ptr, size_t fg_stride,
+                                  const uint8_t* bg_ptr, size_t bg_stride,
+                                  uint8_t* out_ptr,
+                                  size_t w, size_t h);
+
+  // two step keying: the distance map of the last chroma_compute_distance(),
+  // chroma_key_frame() or chroma_set_distance() call is kept in ctx, so that
+  // chroma_composite() can be repeated for several thresholds
+
+  CHROMA_API int chroma_compute_distance(chroma_ctx* ctx,
+                                         const uint8_t* fg_ptr, size_t fg_stride,
+                                         size_t w, size_t h);
+
+  CHROMA_API int chroma_composite(chroma_ctx* ctx,
+                                  const uint8_t* fg_ptr, size_t fg_stride,
+                                  const uint8_t* bg_ptr, size_t bg_stride,
+                                  uint8_t* out_ptr,
+                                  size_t w, size_t h);
+
+  // key decision of the kept distance map, no background involved: matte
+  // writes packed 8 bit alpha (255 foreground, 0 elsewhere), matte_rgba packed
+  // rgba32 rows with the (despilled) foreground and that alpha
+
+  CHROMA_API int chroma_matte(chroma_ctx* ctx, uint8_t* out_ptr, size_t w, size_t h);
+
+  CHROMA_API int chroma_matte_rgba(chroma_ctx* ctx,
+                                   const uint8_t* fg_ptr, size_t fg_stride,
+                                   uint8_t* out_ptr,
+                                   size_t w, size_t h);
+
+  // distance map quantized to 16 bits, packed rows of w samples; 65535
+  // marks the pixels without a distance (black ones)
+
+  CHROMA_API int chroma_get_distance(chroma_ctx* ctx, uint16_t* map_ptr, size_t w, size_t h);
+
+  CHROMA_API int chroma_set_distance(chroma_ctx* ctx, const uint16_t* map_ptr, size_t w, size_t h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,289 @@
+// frame_ring.cpp
+// Description: This is the implementation of class frame_ring
+
+#include <string>
+#include <sstream>
+#include <exception>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <chrono>
+#include <new>
+#include <cerrno>
+#include <cstdint>
+#include <ctime>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "frame_ring.hpp"
+
+using namespace std;
+
+// busy polls before sleeping between polls
+#define SPIN_POLLS 64
+#define SLEEP_US 20
+
+static size_t align__(size_t n) { return (n + FRAME_RING_ALIGNMENT - 1) / FRAME_RING_ALIGNMENT * FRAME_RING_ALIGNMENT; }
+
+// err is the errno of the failed call, saved by the caller before any cleanup;
+// system_error appends its description to the message
+static void throw_errno__(int err, const char* what, const string& name, const char* func, int line)
+{
+  ostringstream str_stream;
+  str_stream << what << " " << name << " ("
+    << func << "() in "<< __FILE__<<":"<<line<<")";
+
+  throw system_error(err, system_category(), str_stream.str());
+}
+
+uint64_t ring_lib::monotonic_ns()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+ring_lib::frame_ring::frame_ring(const string& name, bool owner, void* memory, size_t size)
+: name__{name},
+  owner__{owner},
+  memory__{memory},
+  size__{size},
+  header__{static_cast<frame_ring_header*>(memory)},
+  width__{header__->width},
+  height__{header__->height},
+  channels__{header__->channels},
+  slots__{header__->slots},
+  stages__{header__->stages},
+  row_stride__{header__->row_stride},
+  slot_size__{header__->slot_size},
+  frames_offset__{header__->frames_offset}
+{}
+
+ring_lib::frame_ring::frame_ring(frame_ring&& r)
+: name__{r.name__},
+  owner__{r.owner__},
+  memory__{r.memory__},
+  size__{r.size__},
+  header__{r.header__},
+  width__{r.width__},
+  height__{r.height__},
+  channels__{r.channels__},
+  slots__{r.slots__},
+  stages__{r.stages__},
+  row_stride__{r.row_stride__},
+  slot_size__{r.slot_size__},
+  frames_offset__{r.frames_offset__}
+{
+  r.owner__ = false;
+  r.memory__ = nullptr;
+  r.header__ = nullptr;
+  r.size__ = 0;
+}
+
+ring_lib::frame_ring::~frame_ring()
+{
+  if (memory__) munmap(memory__, size__);
+  if (owner__) shm_unlink(name__.c_str());
+}
+
+ring_lib::frame_ring ring_lib::frame_ring::create(const string& name,
+                                                  size_t width, size_t height, size_t channels,
+                                                  size_t slots, size_t stages, bool replace)
+{
+  if (!width || !height || !channels || !slots || stages < 2 || stages > FRAME_RING_MAX_STAGES ||
+      width > UINT32_MAX || height > UINT32_MAX || channels > UINT32_MAX || slots > UINT32_MAX) {
+    ostringstream str_stream;
+    str_stream << "bad geometry! cannot create frame ring " << name << " ("
+      << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
+
+    throw invalid_argument(str_stream.str());
+  }
+
+  size_t row_stride = width * channels;
+  size_t slot_size = align__(sizeof(frame_slot_header)) + align__(row_stride * height);
+  size_t frames_offset = align__(sizeof(frame_ring_header));
+  size_t size = frames_offset + slots * slot_size;
+
+  // an existing ring may still be in use, it is only replaced on request
+  if (replace) shm_unlink(name.c_str());
+
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) throw_errno__(errno, "cannot create frame ring", name, __func__, __LINE__);
+
+  if (ftruncate(fd, size) < 0) {
+    int err = errno;
+    ::close(fd);
+    shm_unlink(name.c_str());
+    throw_errno__(err, "cannot size frame ring", name, __func__, __LINE__);
+  }
+
+  void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  int err = errno;
+  ::close(fd);
+  if (memory == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    throw_errno__(err, "cannot map frame ring", name, __func__, __LINE__);
+  }
+
+  frame_ring_header* header = new (memory) frame_ring_header;
+  header->version = FRAME_RING_VERSION;
+  header->width = width;
+  header->height = height;
+  header->channels = channels;
+  header->slots = slots;
+  header->stages = stages;
+  header->row_stride = row_stride;
+  header->slot_size = slot_size;
+  header->frames_offset = frames_offset;
+  for (size_t s = 0; s < FRAME_RING_MAX_STAGES; s++) {
+    header->cursors[s].position.store(0, memory_order_relaxed);
+    header->cursors[s].done.store(0, memory_order_relaxed);
+  }
+
+  // published last, attach() checks it
+  atomic_thread_fence(memory_order_release);
+  header->magic = FRAME_RING_MAGIC;
+
+  return frame_ring{name, true, memory, size};
+}
+
+ring_lib::frame_ring ring_lib::frame_ring::attach(const string& name)
+{
+  int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) throw_errno__(errno, "cannot open frame ring", name, __func__, __LINE__);
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    int err = errno;
+    ::close(fd);
+    throw_errno__(err, "cannot stat frame ring", name, __func__, __LINE__);
+  }
+
+  size_t size = st.st_size;
+  if (size < sizeof(frame_ring_header)) {
+    ::close(fd);
+    ostringstream str_stream;
+    str_stream << "frame ring " << name << " is too small ("
+      << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
+
+    throw runtime_error(str_stream.str());
+  }
+
+  void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  int err = errno;
+  ::close(fd);
+  if (memory == MAP_FAILED) throw_errno__(err, "cannot map frame ring", name, __func__, __LINE__);
+
+  // magic is published last by create(), the geometry is read after it
+  frame_ring_header* header = static_cast<frame_ring_header*>(memory);
+  bool published = (header->magic == FRAME_RING_MAGIC);
+  atomic_thread_fence(memory_order_acquire);
+
+  frame_ring ring{name, false, memory, size};
+
+  if (!published || header->version != FRAME_RING_VERSION ||
+      ring.stages__ < 2 || ring.stages__ > FRAME_RING_MAX_STAGES) {
+    ostringstream str_stream;
+    str_stream << name << " is not a version " << FRAME_RING_VERSION << " frame ring ("
+      << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
+
+    throw runtime_error(str_stream.str());
+  }
+
+  // the header is written by another process: every slot, and every row of
+  // its frame, must lie within the mapping (checked without overflowing)
+  size_t width = ring.width__, height = ring.height__, channels = ring.channels__;
+  size_t slots = ring.slots__, row_stride = ring.row_stride__;
+  size_t slot_size = ring.slot_size__, frames_offset = ring.frames_offset__;
+  size_t pixels_offset = align__(sizeof(frame_slot_header));
+
+  if (!width || !height || !channels || !slots ||
+      width > SIZE_MAX / channels || row_stride < width * channels ||
+      frames_offset < sizeof(frame_ring_header) || frames_offset > size ||
+      slot_size > (size - frames_offset) / slots ||
+      slot_size < pixels_offset || row_stride > (slot_size - pixels_offset) / height) {
+    ostringstream str_stream;
+    str_stream << "bad geometry! frame ring " << name << " does not fit its "
+      << size << " bytes (" << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
+
+    throw runtime_error(str_stream.str());
+  }
+
+  return ring;
+}
+
+uint8_t* ring_lib::frame_ring::slot__(uint64_t position, frame_slot_header*& slot) const
+{
+  uint8_t* base = static_cast<uint8_t*>(memory__) + frames_offset__
+                  + (position % slots__) * slot_size__;
+
+  slot = reinterpret_cast<frame_slot_header*>(base);
+  return base + align__(sizeof(frame_slot_header));
+}
+
+void ring_lib::frame_ring::check_stage__(size_t stage, const char* func) const
+{
+  if (stage >= stages__) {
+    ostringstream str_stream;
+    str_stream << "out of range! stage " << stage << " of a " << stages__
+      << " stage frame ring " << name__ << " (" << func << "() in "<< __FILE__<<":"<<__LINE__<<")";
+
+    throw out_of_range(str_stream.str());
+  }
+}
+
+uint8_t* ring_lib::frame_ring::try_acquire(size_t stage, frame_slot_header*& slot)
+{
+  check_stage__(stage, __func__);
+
+  frame_ring_cursor* cursors = header__->cursors;
+
+  // only this stage writes its own cursor
+  uint64_t mine = cursors[stage].position.load(memory_order_relaxed);
+
+  if (stage == 0) {
+    uint64_t last = cursors[stages__ - 1].position.load(memory_order_acquire);
+    if (mine - last >= slots__) return nullptr;
+  } else {
+    uint64_t previous = cursors[stage - 1].position.load(memory_order_acquire);
+    if (mine >= previous) return nullptr;
+  }
+
+  return slot__(mine, slot);
+}
+
+uint8_t* ring_lib::frame_ring::acquire(size_t stage, frame_slot_header*& slot)
+{
+  check_stage__(stage, __func__);
+
+  size_t waited = stage ? stage - 1 : stages__ - 1;
+
+  for (size_t polls = 0; ; polls++) {
+    uint8_t* pixels = try_acquire(stage, slot);
+    if (pixels) return pixels;
+
+    // done is set after the last release, so one more try drains the ring
+    if (header__->cursors[waited].done.load(memory_order_acquire)) return try_acquire(stage, slot);
+
+    if (polls < SPIN_POLLS) this_thread::yield();
+    else this_thread::sleep_for(chrono::microseconds(SLEEP_US));
+  }
+}
+
+void ring_lib::frame_ring::release(size_t stage)
+{
+  check_stage__(stage, __func__);
+
+  atomic<uint64_t>& position = header__->cursors[stage].position;
+  position.store(position.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+void ring_lib::frame_ring::close(size_t stage)
+{
+  check_stage__(stage, __func__);
+
+  header__->cursors[stage].done.store(1, memory_order_release);
+}
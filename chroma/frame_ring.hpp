@@ -0,0 +1,130 @@
+// frame_ring.hpp
+// Description: This is the header file of class frame_ring, a lock-free ring
+// of fixed-size frame slots in POSIX shared memory. Slots go through a
+// pipeline of stages: stage 0 fills them, every later stage processes the
+// slots released by the previous one, and stage 0 reuses them once the last
+// stage releases them. Each stage is run by a single thread, so each cursor
+// has a single writer (single-producer/single-consumer between stages).
+
+#ifndef FRAME_RING_HPP
+#define FRAME_RING_HPP
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+namespace ring_lib {
+
+  #define FRAME_RING_MAGIC 0x474e495243414d43ULL
+  #define FRAME_RING_VERSION 1
+  #define FRAME_RING_MAX_STAGES 3
+  #define FRAME_RING_ALIGNMENT 64
+
+  // uint64_t is unsigned long or unsigned long long depending on the data model
+  static_assert(ATOMIC_LONG_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+                "frame_ring needs lock-free atomics to share them between processes");
+
+  // shared memory layout: frame_ring_header, then slots of slot_size bytes
+  // starting at frames_offset, each one a frame_slot_header followed, at
+  // FRAME_RING_ALIGNMENT bytes, by height rows of row_stride bytes
+
+  struct alignas(FRAME_RING_ALIGNMENT) frame_ring_cursor {
+    atomic<uint64_t> position; // slots released by the stage so far
+    atomic<uint32_t> done;     // the stage will release no more slots
+  };
+
+  struct frame_ring_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;
+    uint32_t slots;
+    uint32_t stages;
+    uint64_t row_stride;
+    uint64_t slot_size;
+    uint64_t frames_offset;
+    frame_ring_cursor cursors[FRAME_RING_MAX_STAGES];
+  };
+
+  struct frame_slot_header {
+    uint64_t sequence;
+    uint64_t timestamp_ns; // capture time, CLOCK_MONOTONIC
+  };
+
+  class frame_ring {
+
+  private:
+    string name__;
+    bool owner__;
+    void* memory__;
+    size_t size__;
+    frame_ring_header* header__;
+
+    // geometry copied from the header when the ring is mapped, so that
+    // another process cannot change it once checked
+    size_t width__;
+    size_t height__;
+    size_t channels__;
+    size_t slots__;
+    size_t stages__;
+    size_t row_stride__;
+    size_t slot_size__;
+    size_t frames_offset__;
+
+    frame_ring(const string& name, bool owner, void* memory, size_t size);
+
+    uint8_t* slot__(uint64_t position, frame_slot_header*& slot) const;
+
+    void check_stage__(size_t stage, const char* func) const;
+
+  public:
+    // creates and owns the ring, which is unlinked when the owner is destroyed.
+    // Fails with EEXIST if the name is taken, unless replace is set by a
+    // caller that knows the existing ring is stale (left by a crashed owner)
+    static frame_ring create(const string& name,
+                             size_t width, size_t height, size_t channels,
+                             size_t slots, size_t stages, bool replace = false);
+
+    // attaches to a ring created by another process, whose header is checked
+    // to describe slots that fit the shared memory
+    static frame_ring attach(const string& name);
+
+    frame_ring(const frame_ring&) = delete;
+    frame_ring& operator=(const frame_ring&) = delete;
+
+    frame_ring(frame_ring&& r);
+
+    ~frame_ring();
+
+    size_t width() const { return width__; }
+    size_t height() const { return height__; }
+    size_t channels() const { return channels__; }
+    size_t row_stride() const { return row_stride__; }
+    size_t slots() const { return slots__; }
+    size_t stages() const { return stages__; }
+
+    // pixels of the next slot of stage, or nullptr if there is none yet
+    uint8_t* try_acquire(size_t stage, frame_slot_header*& slot);
+
+    // waits for the next slot of stage; nullptr once the previous stage is
+    // done and drained (for stage 0, once the last stage is done)
+    uint8_t* acquire(size_t stage, frame_slot_header*& slot);
+
+    // hands the acquired slot over to the next stage
+    void release(size_t stage);
+
+    void close(size_t stage);
+
+    // every stage argument must be below stages(), or out_of_range is thrown
+
+  };
+
+  uint64_t monotonic_ns();
+
+}
+
+#endif
@@ -8,6 +8,12 @@
 #include <stdexcept>
 #include <system_error>
 #include <cmath>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <csetjmp>
 
 #include "matrix.hpp"
 #include "image.hpp"
@@ -17,10 +23,186 @@ using namespace std;
 
 #define EPS 1e-16
 
+// range of hsv_distance(), mapped onto the 16 bit distance maps, whose last
+// code is kept for pixels without a distance (black, whose saturation is 0/0)
+#define DIST_MIN 1.0
+#define DIST_MAX 6.0
+#define DIST_LEVELS 65534
+#define DIST_NAN 65535
+
+#define HUE_BINS 36
+#define SAT_BINS 4
+#define MIN_KEY_SAT 0.2
+#define MIN_KEY_VAL 0.2
+
 void image_lib::read_image(gil::rgb8_image_t& img, string& filename) { gil::read_and_convert_image(filename, img, gil::png_tag() ); }
 
 void image_lib::write_image(gil::rgb8_image_t& img, string& filename) { gil::write_view(filename, gil::view(img), gil::png_tag()); }
 
+void image_lib::write_image(gil::gray8_image_t& img, string& filename) { gil::write_view(filename, gil::view(img), gil::png_tag()); }
+
+void image_lib::write_image(gil::rgba8_image_t& img, string& filename) { gil::write_view(filename, gil::view(img), gil::png_tag()); }
+
+static bool is_png__(const string& filename)
+{
+  return filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".png") == 0;
+}
+
+// 16 bit grayscale PNG written through libpng: GIL (as of Boost 1.74) never
+// swaps 16 bit samples to the big endian order of PNG when writing, though it
+// does when reading, so distance maps are written here with an explicit
+// png_set_swap() on little endian hosts
+static void write_gray16_png__(const gil::gray16c_view_t& vw, const string& filename)
+{
+  FILE* file = fopen(filename.c_str(), "wb");
+  png_structp png = file ? png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr) : nullptr;
+  png_infop info = png ? png_create_info_struct(png) : nullptr;
+  volatile bool written = false;
+
+  if (info && !setjmp(png_jmpbuf(png))) {
+    png_init_io(png, file);
+    png_set_IHDR(png, info, vw.width(), vw.height(), 16, PNG_COLOR_TYPE_GRAY,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+
+    const uint16_t one = 1;
+    if (*(const unsigned char*) &one == 1) png_set_swap(png);
+
+    for (size_t h = 0; h < (size_t) vw.height(); h++)
+      png_write_row(png, (png_const_bytep) &(*vw.row_begin(h)));
+
+    png_write_end(png, nullptr);
+    written = true;
+  }
+
+  if (png) png_destroy_write_struct(&png, info ? &info : nullptr);
+  if (file && fclose(file) != 0) written = false;
+
+  if (!written) {
+    ostringstream str_stream;
+    str_stream << "cannot write " << filename << " ("
+      << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
+
+    throw runtime_error(str_stream.str());
+  }
+}
+
+void image_lib::read_distance(gil::gray16_image_t& map, string& filename, size_t width, size_t height)
+{
+  // GIL does swap the big endian samples when reading; dist_roundtrip_png
+  // checks both directions
+  if (is_png__(filename)) {
+    gil::read_image(filename, map, gil::png_tag());
+    return;
+  }
+
+  ifstream file(filename, ios::binary);
+  if (!file) {
+    ostringstream str_stream;
+    str_stream << "cannot open " << filename << " ("
+      << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
+
+    throw runtime_error(str_stream.str());
+  }
+
+  vector<unsigned char> bytes(2*width*height);
+  file.read((char*) bytes.data(), bytes.size());
+  if ((size_t) file.gcount() != bytes.size() || file.peek() != EOF) {
+    ostringstream str_stream;
+    str_stream << "size mismatch! " << filename << " is not a "
+      << width << "x" << height << " distance map ("
+      << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
+
+    throw invalid_argument(str_stream.str());
+  }
+
+  map.recreate(width, height);
+  gil::gray16_view_t vw = gil::view(map);
+
+  size_t k = 0;
+  for (size_t h = 0; h < height; h++) {
+    auto iter = vw.row_begin(h);
+    for (size_t w = 0; w < width; w++, k += 2) {
+      *iter = gil::gray16_pixel_t(bytes[k] | (bytes[k+1] << 8));
+      iter++;
+    }
+  }
+}
+
+void image_lib::write_distance(gil::gray16_image_t& map, string& filename)
+{
+  if (is_png__(filename)) {
+    write_gray16_png__(gil::const_view(map), filename);
+    return;
+  }
+
+  gil::gray16_view_t vw = gil::view(map);
+  vector<unsigned char> bytes;
+  bytes.reserve(2*vw.width()*vw.height());
+
+  for (size_t h = 0; h < (size_t) vw.height(); h++) {
+    auto iter = vw.row_begin(h);
+    for (size_t w = 0; w < (size_t) vw.width(); w++) {
+      uint16_t d = gil::at_c<0>(*iter);
+      bytes.push_back(d & 0xff);
+      bytes.push_back(d >> 8);
+      iter++;
+    }
+  }
+
+  ofstream file(filename, ios::binary);
+  file.write((const char*) bytes.data(), bytes.size());
+  if (!file) {
+    ostringstream str_stream;
+    str_stream << "cannot write " << filename << " ("
+      << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
+
+    throw runtime_error(str_stream.str());
+  }
+}
+
+void image_lib::quantize_distance(const gil::gray16_view_t& map, mat_lib::matrix<double>& distance)
+{
+  if ((size_t) map.width() != distance.columns() || (size_t) map.height() != distance.rows()) {
+    ostringstream str_stream;
+    str_stream << "size mismatch! cannot quantize distance ("
+      << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
+
+    throw invalid_argument(str_stream.str());
+  }
+
+  for (size_t h = 0; h < distance.rows(); h++) {
+    auto iter = map.row_begin(h);
+    for (size_t w = 0; w < distance.columns(); w++) {
+      double d = (distance[h][w] - DIST_MIN) / (DIST_MAX - DIST_MIN);
+
+      if (std::isnan(d)) *iter = gil::gray16_pixel_t(DIST_NAN);
+      else {
+        d = std::min(std::max(d, 0.0), 1.0);
+        *iter = gil::gray16_pixel_t((uint16_t) round(d * DIST_LEVELS));
+      }
+      iter++;
+    }
+  }
+}
+
+void image_lib::dequantize_distance(mat_lib::matrix<double>& distance, const gil::gray16c_view_t& map)
+{
+  size_t height = map.height(), width = map.width();
+
+  if (distance.rows() != height || distance.columns() != width)
+    distance = mat_lib::matrix<double>(height, width);
+
+  for (size_t h = 0; h < height; h++) {
+    auto iter = map.row_begin(h);
+    for (size_t w = 0; w < width; w++) {
+      uint16_t d = gil::at_c<0>(*iter);
+      distance[h][w] = (d == DIST_NAN) ? NAN : DIST_MIN + d / (double) DIST_LEVELS * (DIST_MAX - DIST_MIN);
+      iter++;
+    }
+  }
+}
+
 
 void image_lib::mask_image(gil::rgb8_image_t& image, mat_lib::matrix<double>& mask)
 {
@@ -141,25 +323,35 @@ void image_lib::rgb2hsv(mat_lib::matrix<double>& hue,
              mat_lib::matrix<double>& value,
              gil::rgb8_image_t& image)
 {
+  rgb2hsv(hue, saturation, value, gil::const_view(image));
+}
 
-  mat_lib::matrix<double> ht(image.height(), image.width());
-  hue = ht;
+void image_lib::rgb2hsv(mat_lib::matrix<double>& hue,
+             mat_lib::matrix<double>& saturation,
+             mat_lib::matrix<double>& value,
+             const gil::rgb8c_view_t& view)
+{
+  size_t height = view.height(), width = view.width();
 
-  mat_lib::matrix<double> st(image.height(), image.width());
-  saturation = st;
+  // reuse the matrices when they already fit the view
+  if (hue.rows() != height || hue.columns() != width)
+    hue = mat_lib::matrix<double>(height, width);
 
-  mat_lib::matrix<double> vt(image.height(), image.width());
-  value = vt;
+  if (saturation.rows() != height || saturation.columns() != width)
+    saturation = mat_lib::matrix<double>(height, width);
 
-  gil::rgb8_view_t vw = gil::view(image);
-  auto iter = vw.begin();
+  if (value.rows() != height || value.columns() != width)
+    value = mat_lib::matrix<double>(height, width);
 
-  for (size_t h = 0; h < image.height(); h++) {
-    for (size_t w = 0; w < image.width(); w++) {
+  for (size_t h = 0; h < height; h++) {
+    auto iter = view.row_begin(h);
+
+    for (size_t w = 0; w < width; w++) {
 
       double hval, sval, vval;
+      gil::rgb8_pixel_t px = *iter;
 
-      rgb2hsv(hval, sval, vval, *iter);
+      rgb2hsv(hval, sval, vval, px);
 
       hue[h][w] = hval;
       saturation[h][w] = sval;
@@ -180,56 +372,311 @@ void image_lib::hsv_distance(mat_lib::matrix<double>& distance,
                   double val_key
                  )
 {
+  if (hue.rows() != saturation.rows() || hue.columns() != saturation.columns()) {
+    ostringstream str_stream;
+    str_stream << "size mismatch! cannot compute hsv distance ("
+      << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
 
-  // distancia hue
-  mat_lib::matrix<double> diff_hue = (hue - hue_key).abs();
-  mat_lib::matrix<double> dist_hue = diff_hue.min(diff_hue * -1.0 + 1.0);
+    throw invalid_argument(str_stream.str());
+  }
+
+  // reuse the matrix when it already fits
+  if (distance.rows() != hue.rows() || distance.columns() != hue.columns())
+    distance = mat_lib::matrix<double>(hue.rows(), hue.columns());
 
-  // distancia saturacion
-  mat_lib::matrix<double> dist_sat = (saturation - sat_key).abs();
+  for (size_t h = 0; h < hue.rows(); h++) {
+    const double* hrow = hue[h];
+    const double* srow = saturation[h];
+    double* drow = distance[h];
 
-  // distancia total
-  distance = ((dist_hue^2.0) + (dist_sat^2.0)) / pow(0.5, 2.0) + 1.0;
+    for (size_t w = 0; w < hue.columns(); w++) {
+      // distancia hue
+      double diff_hue = abs(hrow[w] - hue_key);
+      double dist_hue = min(diff_hue, diff_hue * -1.0 + 1.0);
+
+      // distancia saturacion
+      double dist_sat = abs(srow[w] - sat_key);
+
+      // distancia total
+      drow[w] = (pow(dist_hue, 2.0) + pow(dist_sat, 2.0)) / pow(0.5, 2.0) + 1.0;
+    }
+  }
 
 }
 
-void image_lib::chroma_keying(gil::rgb8_image_t& result,
-                   gil::rgb8_image_t fg_image,
-                   gil::rgb8_image_t bg_image,
-                   gil::rgb8_pixel_t& key_color,
-                   double threshold)
+void image_lib::estimate_key_color(gil::rgb8_pixel_t& key_color,
+                        double& confidence,
+                        gil::rgb8_image_t& image,
+                        size_t stride)
 {
-  if (fg_image.width() != bg_image.width() || fg_image.height() != bg_image.height())
-  {
+  estimate_key_color(key_color, confidence, gil::const_view(image), stride);
+}
+
+void image_lib::estimate_key_color(gil::rgb8_pixel_t& key_color,
+                        double& confidence,
+                        const gil::rgb8c_view_t& vw,
+                        size_t stride)
+{
+  if (vw.width() == 0 || vw.height() == 0 || stride == 0) {
     ostringstream str_stream;
-    str_stream << "size mismatch! cannot apply chroma keying ("
+    str_stream << "empty image or null stride! cannot estimate key color ("
       << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
 
     throw invalid_argument(str_stream.str());
   }
 
-  // create hue / saturation matrices
+  // hue / saturation histogram, keeping the rgb sum of every bin to
+  // recover the key color of the peak
+  vector<size_t> counts(HUE_BINS*SAT_BINS, 0);
+  vector<double> sums(3*HUE_BINS*SAT_BINS, 0.0);
+  size_t samples = 0;
+
+  auto sample = [&](size_t w, size_t h) {
+    gil::rgb8_pixel_t px = vw(w, h);
+    samples++;
+
+    double hval, sval, vval;
+    rgb2hsv(hval, sval, vval, px);
+
+    // greys and dark pixels say nothing about the backing hue
+    if (sval < MIN_KEY_SAT || vval < MIN_KEY_VAL) return;
+
+    size_t hbin = std::min((size_t) (hval * HUE_BINS), (size_t) HUE_BINS - 1);
+    size_t sbin = std::min((size_t) (sval * SAT_BINS), (size_t) SAT_BINS - 1);
+    size_t bin = hbin*SAT_BINS + sbin;
+
+    counts[bin]++;
+    sums[3*bin]   += px[0];
+    sums[3*bin+1] += px[1];
+    sums[3*bin+2] += px[2];
+  };
+
+  size_t width = vw.width(), height = vw.height();
+
+  // border rows and columns, where the backing almost always shows, and a
+  // grid over the interior, both at the same stride so that neither of them
+  // outweighs the other
+  for (size_t w = 0; w < width; w += stride) {
+    sample(w, 0);
+    if (height > 1) sample(w, height - 1);
+  }
+  for (size_t h = stride; h + 1 < height; h += stride) {
+    sample(0, h);
+    if (width > 1) sample(width - 1, h);
+  }
+
+  for (size_t h = stride; h + 1 < height; h += stride) {
+    for (size_t w = stride; w + 1 < width; w += stride) {
+      sample(w, h);
+    }
+  }
+
+  size_t peak = 0;
+  for (size_t bin = 1; bin < counts.size(); bin++) {
+    if (counts[bin] > counts[peak]) peak = bin;
+  }
+
+  if (counts[peak] == 0) {
+    ostringstream str_stream;
+    str_stream << "no saturated pixels! cannot estimate key color ("
+      << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
+
+    throw runtime_error(str_stream.str());
+  }
+
+  unsigned char red   = round(sums[3*peak]   / counts[peak]);
+  unsigned char green = round(sums[3*peak+1] / counts[peak]);
+  unsigned char blue  = round(sums[3*peak+2] / counts[peak]);
+
+  key_color = gil::rgb8_pixel_t{red, green, blue};
+  confidence = (double) counts[peak] / samples;
+}
+
+void image_lib::chroma_keying(gil::rgb8_image_t& result,
+                   gil::rgb8_image_t fg_image,
+                   gil::rgb8_image_t bg_image,
+                   gil::rgb8_pixel_t& key_color,
+                   double threshold)
+{
   mat_lib::matrix<double> hmat;
   mat_lib::matrix<double> smat;
   mat_lib::matrix<double> vmat;
-  image_lib::rgb2hsv(hmat, smat, vmat, fg_image);
+  mat_lib::matrix<double> dist;
+
+  chroma_keying(gil::view(result),
+                gil::const_view(fg_image),
+                gil::const_view(bg_image),
+                key_color,
+                threshold,
+                DESPILL_NONE,
+                hmat, smat, vmat, dist);
+}
+
+void image_lib::key_distance(mat_lib::matrix<double>& distance,
+                  const gil::rgb8c_view_t& fg_view,
+                  gil::rgb8_pixel_t& key_color,
+                  mat_lib::matrix<double>& hue,
+                  mat_lib::matrix<double>& saturation,
+                  mat_lib::matrix<double>& value)
+{
+  // create hue / saturation matrices
+  image_lib::rgb2hsv(hue, saturation, value, fg_view);
 
   // convert key color to hsv
   double hkey, skey, vkey;
   rgb2hsv(hkey, skey, vkey, key_color);
 
   // create distance matrix
-  mat_lib::matrix<double> dist;
-  image_lib::hsv_distance(dist, hmat, smat, vmat, hkey, skey, vkey);
+  image_lib::hsv_distance(distance, hue, saturation, value, hkey, skey, vkey);
+}
+
+static inline void despill__(gil::rgb8_pixel_t& px, int spill, image_lib::despill_mode despill)
+{
+  int a = px[(spill + 1) % 3];
+  int b = px[(spill + 2) % 3];
+  int limit = (despill == image_lib::DESPILL_MAX) ? max(a, b) : (a + b) / 2;
+
+  if (px[spill] > limit) px[spill] = (unsigned char) limit;
+}
+
+void image_lib::composite(const gil::rgb8_view_t& result,
+               const gil::rgb8c_view_t& fg_view,
+               const gil::rgb8c_view_t& bg_view,
+               mat_lib::matrix<double>& distance,
+               double threshold,
+               gil::rgb8_pixel_t& key_color,
+               despill_mode despill)
+{
+  if (fg_view.width() != bg_view.width() || fg_view.height() != bg_view.height() ||
+      fg_view.width() != result.width() || fg_view.height() != result.height() ||
+      (size_t) fg_view.width() != distance.columns() || (size_t) fg_view.height() != distance.rows())
+  {
+    ostringstream str_stream;
+    str_stream << "size mismatch! cannot composite images ("
+      << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
+
+    throw invalid_argument(str_stream.str());
+  }
+
+  // channel the key spills into
+  int spill = 0;
+  if (key_color[1] > key_color[spill]) spill = 1;
+  if (key_color[2] > key_color[spill]) spill = 2;
+
+  // foreground where dist > threshold, background where dist < threshold
+  // and black on the threshold itself, as masking and adding both images
+  for (size_t h = 0; h < (size_t) fg_view.height(); h++) {
+    auto iter_fg = fg_view.row_begin(h);
+    auto iter_bg = bg_view.row_begin(h);
+    auto iter_res = result.row_begin(h);
+
+    for (size_t w = 0; w < (size_t) fg_view.width(); w++) {
+      double d = distance[h][w];
+
+      if (d > threshold) {
+        gil::rgb8_pixel_t px = *iter_fg;
+        if (despill != DESPILL_NONE) despill__(px, spill, despill);
+        *iter_res = px;
+      }
+      else if (d < threshold) *iter_res = *iter_bg;
+      else                    *iter_res = gil::rgb8_pixel_t{0, 0, 0};
+
+      iter_fg++;
+      iter_bg++;
+      iter_res++;
+    }
+  }
+}
+
+void image_lib::matte(const gil::gray8_view_t& result,
+           mat_lib::matrix<double>& distance,
+           double threshold)
+{
+  if ((size_t) result.width() != distance.columns() || (size_t) result.height() != distance.rows())
+  {
+    ostringstream str_stream;
+    str_stream << "size mismatch! cannot build matte ("
+      << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
+
+    throw invalid_argument(str_stream.str());
+  }
+
+  for (size_t h = 0; h < distance.rows(); h++) {
+    auto iter_res = result.row_begin(h);
+    const double* d = distance[h];
+
+    for (size_t w = 0; w < distance.columns(); w++) {
+      *iter_res = gil::gray8_pixel_t(d[w] > threshold ? 255 : 0);
+      iter_res++;
+    }
+  }
+}
 
-  // create masks
-  mat_lib::matrix<double> fg_mask = (dist > threshold);
+void image_lib::matte_rgba(const gil::rgba8_view_t& result,
+                const gil::rgb8c_view_t& fg_view,
+                mat_lib::matrix<double>& distance,
+                double threshold,
+                gil::rgb8_pixel_t& key_color,
+                despill_mode despill)
+{
+  if (fg_view.width() != result.width() || fg_view.height() != result.height() ||
+      (size_t) fg_view.width() != distance.columns() || (size_t) fg_view.height() != distance.rows())
+  {
+    ostringstream str_stream;
+    str_stream << "size mismatch! cannot build matte ("
+      << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
 
-  mat_lib::matrix<double> bg_mask = (dist < threshold); // 1 - fg_mask
+    throw invalid_argument(str_stream.str());
+  }
 
-  mask_image(fg_image, fg_mask);
-  mask_image(bg_image, bg_mask);
+  // channel the key spills into
+  int spill = 0;
+  if (key_color[1] > key_color[spill]) spill = 1;
+  if (key_color[2] > key_color[spill]) spill = 2;
+
+  for (size_t h = 0; h < distance.rows(); h++) {
+    auto iter_fg = fg_view.row_begin(h);
+    auto iter_res = result.row_begin(h);
+    const double* d = distance[h];
+
+    for (size_t w = 0; w < distance.columns(); w++) {
+      gil::rgb8_pixel_t px = *iter_fg;
+      unsigned char alpha = 0;
+
+      if (d[w] > threshold) {
+        if (despill != DESPILL_NONE) despill__(px, spill, despill);
+        alpha = 255;
+      }
+      *iter_res = gil::rgba8_pixel_t{px[0], px[1], px[2], alpha};
+
+      iter_fg++;
+      iter_res++;
+    }
+  }
+}
+
+void image_lib::chroma_keying(const gil::rgb8_view_t& result,
+                   const gil::rgb8c_view_t& fg_view,
+                   const gil::rgb8c_view_t& bg_view,
+                   gil::rgb8_pixel_t& key_color,
+                   double threshold,
+                   despill_mode despill,
+                   mat_lib::matrix<double>& hue,
+                   mat_lib::matrix<double>& saturation,
+                   mat_lib::matrix<double>& value,
+                   mat_lib::matrix<double>& distance)
+{
+  if (fg_view.width() != bg_view.width() || fg_view.height() != bg_view.height() ||
+      fg_view.width() != result.width() || fg_view.height() != result.height())
+  {
+    ostringstream str_stream;
+    str_stream << "size mismatch! cannot apply chroma keying ("
+      << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
+
+    throw invalid_argument(str_stream.str());
+  }
 
-  add_image(result, fg_image, bg_image);
+  key_distance(distance, fg_view, key_color, hue, saturation, value);
 
+  composite(result, fg_view, bg_view, distance, threshold, key_color, despill);
 }
@@ -15,12 +15,34 @@ namespace gil = boost::gil;
 
 namespace image_lib {
 
+  // spill suppression of foreground pixels: the key dominant channel is
+  // limited to the average or to the max of the other two channels
+
+  enum despill_mode { DESPILL_NONE = 0, DESPILL_AVERAGE = 1, DESPILL_MAX = 2 };
+
   // io
 
   void read_image(gil::rgb8_image_t& img, string& filename);
 
   void write_image(gil::rgb8_image_t& img, string& filename);
 
+  void write_image(gil::gray8_image_t& img, string& filename);
+
+  void write_image(gil::rgba8_image_t& img, string& filename);
+
+  // distance maps: 16 bit grayscale PNG, or raw little endian samples
+  // (any other extension) whose size is given by width and height. Samples
+  // 0 - 65534 quantize the [1, 6] range of hsv_distance(), 65535 stands for
+  // the NaN distance of black pixels, so that they key as in direct keying
+
+  void read_distance(gil::gray16_image_t& map, string& filename, size_t width, size_t height);
+
+  void write_distance(gil::gray16_image_t& map, string& filename);
+
+  void quantize_distance(const gil::gray16_view_t& map, mat_lib::matrix<double>& distance);
+
+  void dequantize_distance(mat_lib::matrix<double>& distance, const gil::gray16c_view_t& map);
+
   // image masks
 
   void mask_image(gil::rgb8_image_t& image, mat_lib::matrix<double>& mask);
@@ -37,6 +59,11 @@ namespace image_lib {
                mat_lib::matrix<double>& value,
                gil::rgb8_image_t& image);
 
+  void rgb2hsv(mat_lib::matrix<double>& hue,
+               mat_lib::matrix<double>& saturation,
+               mat_lib::matrix<double>& value,
+               const gil::rgb8c_view_t& view);
+
   void hsv_distance(mat_lib::matrix<double>& distance,
                     mat_lib::matrix<double>& hue,
                     mat_lib::matrix<double>& saturation,
@@ -46,12 +73,61 @@ namespace image_lib {
                     double val_key
                   );
 
+  void estimate_key_color(gil::rgb8_pixel_t& key_color,
+                          double& confidence,
+                          gil::rgb8_image_t& image,
+                          size_t stride);
+
+  void estimate_key_color(gil::rgb8_pixel_t& key_color,
+                          double& confidence,
+                          const gil::rgb8c_view_t& view,
+                          size_t stride);
+
+  void key_distance(mat_lib::matrix<double>& distance,
+                    const gil::rgb8c_view_t& fg_view,
+                    gil::rgb8_pixel_t& key_color,
+                    mat_lib::matrix<double>& hue,
+                    mat_lib::matrix<double>& saturation,
+                    mat_lib::matrix<double>& value);
+
+  void composite(const gil::rgb8_view_t& result,
+                 const gil::rgb8c_view_t& fg_view,
+                 const gil::rgb8c_view_t& bg_view,
+                 mat_lib::matrix<double>& distance,
+                 double threshold,
+                 gil::rgb8_pixel_t& key_color,
+                 despill_mode despill);
+
+  // key decision only, no background: 255 where dist > threshold, 0 elsewhere
+
+  void matte(const gil::gray8_view_t& result,
+             mat_lib::matrix<double>& distance,
+             double threshold);
+
+  void matte_rgba(const gil::rgba8_view_t& result,
+                  const gil::rgb8c_view_t& fg_view,
+                  mat_lib::matrix<double>& distance,
+                  double threshold,
+                  gil::rgb8_pixel_t& key_color,
+                  despill_mode despill);
+
   void chroma_keying(gil::rgb8_image_t& result,
                      gil::rgb8_image_t fg_image,
                      gil::rgb8_image_t bg_image,
                      gil::rgb8_pixel_t& key_color,
                      double threshold);
 
+  void chroma_keying(const gil::rgb8_view_t& result,
+                     const gil::rgb8c_view_t& fg_view,
+                     const gil::rgb8c_view_t& bg_view,
+                     gil::rgb8_pixel_t& key_color,
+                     double threshold,
+                     despill_mode despill,
+                     mat_lib::matrix<double>& hue,
+                     mat_lib::matrix<double>& saturation,
+                     mat_lib::matrix<double>& value,
+                     mat_lib::matrix<double>& distance);
+
 }
 
 #endif
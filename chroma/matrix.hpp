@@ -1,7 +1,8 @@
 // matrix.hpp
 // author: Antonio C. Domínguez Brito <antonio.dominguez@ulpgc.es>
 // creation date: september 20th 2020
-// Description: This is the header file of class matrix which is a 2D matrix
+// Description: This is the header file of class matrix which is a 2D matrix,
+// and of class matrix_view, a non-owning strided window over matrix elements
 
 #ifndef MATRIX_HPP
 #define MATRIX_HPP
@@ -12,12 +13,165 @@
 #include <exception>
 #include <stdexcept>
 #include <system_error>
+#include <type_traits>
+#include <new>
 #include <cmath>
+#include <cstdlib>
 
 using namespace std;
 
 namespace mat_lib {
 
+  // matrix rows start on MATRIX_ALIGNMENT byte boundaries
+  #define MATRIX_ALIGNMENT 64
+
+  template<typename T> class matrix;
+
+  template<typename T>
+  class matrix_view {
+
+  public:
+    using element_t = typename remove_const<T>::type;
+
+  private:
+    static_assert(
+      is_integral<element_t>::value ||
+      is_floating_point<element_t>::value,
+      "\n"
+      "[ERROR] <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<\n"
+      "[ERROR] <<<< BAD TYPE <<<<<<<<<<<<<<<<<<<<<<<<<<<<\n"
+      "[ERROR] <<<< ACCEPTED TYPES <<<<<<<<<<<<<<<<<<<<<<\n"
+      "[ERROR] <<<<<<< - All numeric primitive types <<<<\n"
+      "[ERROR] <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<\n"
+    );
+
+    T* elements__;
+    size_t rows__;
+    size_t columns__;
+    size_t stride__; // elements between the starts of two rows
+
+    size_t offset__(size_t i, size_t j) const { return i*stride__+j; }
+
+    void check_size__(const matrix_view<const element_t>& m, const char* func) const
+    {
+      if ((rows()!=m.rows()) || (columns()!=m.columns())) {
+        ostringstream str_stream;
+        str_stream << "size mismatch! cannot operate on matrices ("
+          << func << "() in "<< __FILE__<<":"<<__LINE__<<")";
+
+        throw invalid_argument(str_stream.str());
+      }
+    }
+
+  public:
+    matrix_view()
+    : elements__{nullptr},
+      rows__{0},
+      columns__{0},
+      stride__{0}
+    {}
+
+    matrix_view(T* elements, size_t rows, size_t columns, size_t stride)
+    : elements__{elements},
+      rows__{rows},
+      columns__{columns},
+      stride__{stride}
+    {}
+
+    // read-write views convert to read-only views
+    template<typename U,
+             typename = typename enable_if<is_same<const U, T>::value>::type>
+    matrix_view(const matrix_view<U>& v)
+    : elements__{v[0]},
+      rows__{v.rows()},
+      columns__{v.columns()},
+      stride__{v.stride()}
+    {}
+
+    size_t columns() const {return columns__;}
+    size_t rows() const {return rows__;}
+    size_t size() const {return rows__*columns__;}
+    size_t stride() const {return stride__;}
+
+    element_t at(size_t i, size_t j) const
+    {
+      if (i>=rows__ || j>=columns__) {
+        ostringstream str_stream;
+        str_stream << "out of range! (" << i << ", " << j << ") not in "
+          << rows__ << "x" << columns__ << " matrix ("
+          << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
+
+        throw out_of_range(str_stream.str());
+      }
+      return elements__[offset__(i,j)];
+    }
+
+    T* operator[](size_t i) const { return &(elements__[i*stride__]); }
+
+    // sub-rectangle of rows x columns elements starting at (row, column)
+    matrix_view view(size_t row, size_t column, size_t rows, size_t columns) const
+    {
+      if (row+rows>rows__ || column+columns>columns__) {
+        ostringstream str_stream;
+        str_stream << "out of range! cannot slice " << rows << "x" << columns
+          << " at (" << row << ", " << column << ") from "
+          << rows__ << "x" << columns__ << " matrix ("
+          << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
+
+        throw out_of_range(str_stream.str());
+      }
+      return matrix_view{elements__+offset__(row,column), rows, columns, stride__};
+    }
+
+    const matrix_view& operator+=(const matrix_view<const element_t>& m) const;
+    const matrix_view& operator-=(const matrix_view<const element_t>& m) const;
+    const matrix_view& operator*=(const matrix_view<const element_t>& m) const;
+    const matrix_view& operator/=(const matrix_view<const element_t>& m) const;
+
+    const matrix_view& operator+=(const element_t v) const;
+    const matrix_view& operator-=(const element_t v) const;
+    const matrix_view& operator*=(const element_t v) const;
+    const matrix_view& operator/=(const element_t v) const;
+    const matrix_view& operator^=(const element_t v) const;
+
+    matrix<element_t> abs() const
+    {
+      matrix<element_t> r{*this};
+
+      for (size_t i = 0; i < rows__; i++)
+      {
+        for (size_t j = 0; j < columns__; j++)
+        {
+          r[i][j] = std::abs(r[i][j]);
+        }
+      }
+
+      return r;
+    }
+
+    matrix<element_t> min(const matrix_view<const element_t>& m) const
+    {
+      if ((rows()!=m.rows()) || (columns()!=m.columns())) {
+        ostringstream str_stream;
+        str_stream << "size mismatch! cannot min matrices ("
+          << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
+
+        throw invalid_argument(str_stream.str());
+      }
+
+      matrix<element_t> r{*this};
+
+      for (size_t i = 0; i < rows__; i++) {
+        for (size_t j = 0; j < columns__; j++) {
+          r[i][j] = std::min(r[i][j], m[i][j]);
+        }
+      }
+
+      return r;
+    }
+
+  };
+
   template<typename T>
   class matrix {
 
@@ -38,53 +192,84 @@ namespace mat_lib {
     element_t* elements__;
     size_t rows__;
     size_t columns__;
+    size_t stride__; // row length padded to MATRIX_ALIGNMENT bytes
 
-    size_t row_offset__(size_t i) const { return i*columns__; }
+    size_t row_offset__(size_t i) const { return i*stride__; }
     size_t offset__(size_t i, size_t j) const { return row_offset__(i)+j; }
 
-    void copy_elements__(const matrix& m)
+    static size_t padded_stride__(size_t columns)
+    {
+      const size_t per_line = (MATRIX_ALIGNMENT >= sizeof(element_t))?
+        MATRIX_ALIGNMENT/sizeof(element_t): 1;
+      return ((columns+per_line-1)/per_line)*per_line;
+    }
+
+    static element_t* allocate__(size_t rows, size_t stride)
+    {
+      if (!rows || !stride) return nullptr;
+
+      void* p = nullptr;
+      if (posix_memalign(&p, MATRIX_ALIGNMENT, rows*stride*sizeof(element_t))) throw bad_alloc();
+      return static_cast<element_t*>(p);
+    }
+
+    void copy_elements__(const matrix_view<const element_t>& m)
     {
-      rows__=m.rows__; columns__=m.columns__;
       for (size_t i = 0; i < rows__; i++) {
         for (size_t j = 0; j < columns__; j++) {
-          elements__[offset__(i,j)] = m.elements__[offset__(i,j)];
+          elements__[offset__(i,j)] = m[i][j];
         }
       }
     }
 
   public:
     matrix()
-    : rows__{0},
+    : elements__{nullptr},
+      rows__{0},
       columns__{0},
-      elements__{nullptr}
+      stride__{0}
     {}
 
     matrix (size_t rows, size_t columns)
-    : rows__{rows},
+    : elements__{allocate__(rows, padded_stride__(columns))},
+      rows__{rows},
       columns__{columns},
-      elements__{new element_t[rows*columns]}
+      stride__{padded_stride__(columns)}
     {}
 
     matrix(const matrix& m)
-    : elements__{new element_t[m.size()]}
+    : matrix(m.rows__, m.columns__)
+    {
+      copy_elements__(m);
+    }
+
+    explicit matrix(const matrix_view<const element_t>& m)
+    : matrix(m.rows(), m.columns())
     {
       copy_elements__(m);
     }
 
     matrix(matrix&& m)
-    : rows__{m.rows__},
+    : elements__{m.elements__},
+      rows__{m.rows__},
       columns__{m.columns__},
-      elements__{m.elements__}
+      stride__{m.stride__}
     {
       m.elements__=nullptr;
-      m.rows__=m.columns__=0;
+      m.rows__=m.columns__=m.stride__=0;
     }
 
     matrix& operator=(const matrix& m) // copy assigment
     {
-      if(size() != m.size()) {
-        delete [] elements__;
-        elements__=((m.size())? new element_t[m.size()]: nullptr);
+      if (this == &m) return *this;
+
+      if((rows__ != m.rows__) || (columns__ != m.columns__)) {
+        free(elements__);
+        elements__=nullptr;
+        rows__=columns__=stride__=0;
+
+        elements__=allocate__(m.rows__, padded_stride__(m.columns__));
+        rows__=m.rows__; columns__=m.columns__; stride__=padded_stride__(m.columns__);
       }
       copy_elements__(m);
       return *this;
@@ -92,87 +277,63 @@ namespace mat_lib {
 
     matrix& operator=(matrix&& m) // move assigment
     {
-      delete[] elements__;
+      if (this == &m) return *this;
+
+      free(elements__);
       elements__=m.elements__;
-      rows__ = m.rows__; columns__ = m.columns__;
+      rows__ = m.rows__; columns__ = m.columns__; stride__ = m.stride__;
 
       m.elements__=nullptr;
-      m.rows__=m.columns__=0;
+      m.rows__=m.columns__=m.stride__=0;
 
       return *this;
     }
 
-    ~matrix () { delete [] elements__; }
+    ~matrix () { free(elements__); }
 
-    element_t at(size_t i, size_t j) const;
+    element_t at(size_t i, size_t j) const { return view().at(i, j); }
     size_t columns() const {return columns__;}
     size_t rows() const {return rows__;}
     size_t size() const {return rows__*columns__;}
+    size_t stride() const {return stride__;}
 
     element_t* operator[](size_t i) { return &(elements__[row_offset__(i)]); }
     const element_t* operator[](size_t i) const { return &(elements__[row_offset__(i)]); }
 
-    matrix& operator+=(const matrix& m);
-    matrix& operator-=(const matrix& m);
-    matrix& operator*=(const matrix& m);
-    matrix& operator/=(const matrix& m);
+    // non-owning views, valid while the matrix is neither resized nor destroyed
 
-    matrix& operator+=(const T v);
-    matrix& operator-=(const T v);
-    matrix& operator*=(const T v);
-    matrix& operator/=(const T v);
-    matrix& operator^=(const T v);
+    matrix_view<element_t> view() { return {elements__, rows__, columns__, stride__}; }
+    matrix_view<const element_t> view() const { return {elements__, rows__, columns__, stride__}; }
 
-    matrix abs()
-    {
+    matrix_view<element_t> view(size_t row, size_t column, size_t rows, size_t columns)
+    { return view().view(row, column, rows, columns); }
+    matrix_view<const element_t> view(size_t row, size_t column, size_t rows, size_t columns) const
+    { return view().view(row, column, rows, columns); }
 
-      matrix<element_t> r{*this};
+    operator matrix_view<element_t>() { return view(); }
+    operator matrix_view<const element_t>() const { return view(); }
 
-      for (size_t i = 0; i < rows__; i++)
-      {
-        for (size_t j = 0; j < columns__; j++)
-        {
-          r[i][j] = std::abs(r[i][j]);
-        }
-      }
+    matrix& operator+=(const matrix_view<const element_t>& m) { view() += m; return *this; }
+    matrix& operator-=(const matrix_view<const element_t>& m) { view() -= m; return *this; }
+    matrix& operator*=(const matrix_view<const element_t>& m) { view() *= m; return *this; }
+    matrix& operator/=(const matrix_view<const element_t>& m) { view() /= m; return *this; }
 
-      return r;
+    matrix& operator+=(const T v) { view() += v; return *this; }
+    matrix& operator-=(const T v) { view() -= v; return *this; }
+    matrix& operator*=(const T v) { view() *= v; return *this; }
+    matrix& operator/=(const T v) { view() /= v; return *this; }
+    matrix& operator^=(const T v) { view() ^= v; return *this; }
 
-    }
+    matrix abs() const { return view().abs(); }
 
-    matrix min(matrix m)
-    {
-      if ((rows()!=m.rows()) || (columns()!=m.columns())) {
-        ostringstream str_stream;
-        str_stream << "size mismatch! cannot min matrices ("
-          << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
-
-        throw invalid_argument(str_stream.str());
-      }
-
-      matrix<element_t> r{*this};
-
-      for (size_t i = 0; i < rows__; i++) {
-        for (size_t j = 0; j < columns__; j++) {
-          r[i][j] = std::min(r[i][j], m[i][j]);
-        }
-      }
-
-      return r;
-    }
+    matrix min(const matrix_view<const element_t>& m) const { return view().min(m); }
 
   };
 
   template<typename T>
-  matrix<T>& matrix<T>::operator+=(const matrix<T>& m)
+  const matrix_view<T>& matrix_view<T>::operator+=(const matrix_view<const element_t>& m) const
   {
-    if ((rows()!=m.rows()) || (columns()!=m.columns())) {
-      ostringstream str_stream;
-      str_stream << "size mismatch! cannot add matrices ("
-        << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
-
-      throw invalid_argument(str_stream.str());
-    }
+    check_size__(m, __func__);
 
     for (size_t i = 0; i < m.rows(); i++) {
       for (size_t j = 0; j < m.columns(); j++) {
@@ -183,30 +344,9 @@ namespace mat_lib {
   }
 
   template<typename T>
-  matrix<T> operator+(const matrix<T>& a, const matrix<T>& b)
-  {
-    if ((a.rows()!=b.rows()) || (a.columns()!=b.columns())) {
-      ostringstream str_stream;
-      str_stream << "size mismatch! cannot add matrices ("
-        << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
-
-      throw invalid_argument(str_stream.str());
-    }
-
-    matrix<T> c{a};
-    return c+=b;
-  }
-
-  template<typename T>
-  matrix<T>& matrix<T>::operator-=(const matrix<T>& m)
+  const matrix_view<T>& matrix_view<T>::operator-=(const matrix_view<const element_t>& m) const
   {
-    if ((rows()!=m.rows()) || (columns()!=m.columns())) {
-      ostringstream str_stream;
-      str_stream << "size mismatch! cannot add matrices ("
-        << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
-
-      throw invalid_argument(str_stream.str());
-    }
+    check_size__(m, __func__);
 
     for (size_t i = 0; i < m.rows(); i++) {
       for (size_t j = 0; j < m.columns(); j++) {
@@ -217,187 +357,208 @@ namespace mat_lib {
   }
 
   template<typename T>
-  matrix<T> operator-(const matrix<T>& a, const matrix<T>& b)
+  const matrix_view<T>& matrix_view<T>::operator*=(const matrix_view<const element_t>& m) const
   {
-    if ((a.rows()!=b.rows()) || (a.columns()!=b.columns())) {
-      ostringstream str_stream;
-      str_stream << "size mismatch! cannot add matrices ("
-        << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
+    check_size__(m, __func__);
 
-      throw invalid_argument(str_stream.str());
+    for (size_t i = 0; i < m.rows(); i++) {
+      for (size_t j = 0; j < m.columns(); j++) {
+        elements__[offset__(i, j)] *= m[i][j];
+      }
     }
-
-    matrix<T> c{a};
-    return c-=b;
+    return *this;
   }
 
   template<typename T>
-  matrix<T>& matrix<T>::operator*=(const matrix<T>& m)
+  const matrix_view<T>& matrix_view<T>::operator/=(const matrix_view<const element_t>& m) const
   {
-    if ((rows()!=m.rows()) || (columns()!=m.columns())) {
-      ostringstream str_stream;
-      str_stream << "size mismatch! cannot add matrices ("
-        << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
-
-      throw invalid_argument(str_stream.str());
-    }
+    check_size__(m, __func__);
 
     for (size_t i = 0; i < m.rows(); i++) {
       for (size_t j = 0; j < m.columns(); j++) {
-        elements__[offset__(i, j)] *= m[i][j];
+        elements__[offset__(i, j)] /= m[i][j];
       }
     }
     return *this;
   }
 
   template<typename T>
-  matrix<T> operator*(const matrix<T>& a, const matrix<T>& b)
+  const matrix_view<T>& matrix_view<T>::operator+=(const element_t v) const
   {
-    if ((a.rows()!=b.rows()) || (a.columns()!=b.columns())) {
-      ostringstream str_stream;
-      str_stream << "size mismatch! cannot add matrices ("
-        << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
 
-      throw invalid_argument(str_stream.str());
+    for (size_t i = 0; i < rows(); i++) {
+      for (size_t j = 0; j < columns(); j++) {
+        elements__[offset__(i, j)] += v;
+      }
     }
-
-    matrix<T> c{a};
-    return c*=b;
+    return *this;
   }
 
   template<typename T>
-  matrix<T>& matrix<T>::operator/=(const matrix<T>& m)
+  const matrix_view<T>& matrix_view<T>::operator-=(const element_t v) const
   {
-    if ((rows()!=m.rows()) || (columns()!=m.columns())) {
-      ostringstream str_stream;
-      str_stream << "size mismatch! cannot add matrices ("
-        << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
 
-      throw invalid_argument(str_stream.str());
-    }
-
-    for (size_t i = 0; i < m.rows(); i++) {
-      for (size_t j = 0; j < m.columns(); j++) {
-        elements__[offset__(i, j)] /= m[i][j];
+    for (size_t i = 0; i < rows(); i++) {
+      for (size_t j = 0; j < columns(); j++) {
+        elements__[offset__(i, j)] -= v;
       }
     }
     return *this;
   }
 
   template<typename T>
-  matrix<T> operator/(const matrix<T>& a, const matrix<T>& b)
+  const matrix_view<T>& matrix_view<T>::operator*=(const element_t v) const
   {
-    if ((a.rows()!=b.rows()) || (a.columns()!=b.columns())) {
-      ostringstream str_stream;
-      str_stream << "size mismatch! cannot add matrices ("
-        << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
 
-      throw invalid_argument(str_stream.str());
+    for (size_t i = 0; i < rows(); i++) {
+      for (size_t j = 0; j < columns(); j++) {
+        elements__[offset__(i, j)] *= v;
+      }
     }
-
-    matrix<T> c{a};
-    return c/=b;
+    return *this;
   }
 
   template<typename T>
-  matrix<T> operator+(const matrix<T>& a, const T v)
+  const matrix_view<T>& matrix_view<T>::operator/=(const element_t v) const
   {
-    matrix<T> b{a};
-    return b+=v;
+
+    for (size_t i = 0; i < rows(); i++) {
+      for (size_t j = 0; j < columns(); j++) {
+        elements__[offset__(i, j)] /= v;
+      }
+    }
+    return *this;
   }
 
   template<typename T>
-  matrix<T>& matrix<T>::operator+=(const T v)
+  const matrix_view<T>& matrix_view<T>::operator^=(const element_t v) const
   {
 
     for (size_t i = 0; i < rows(); i++) {
       for (size_t j = 0; j < columns(); j++) {
-        elements__[offset__(i, j)] += v;
+        elements__[offset__(i, j)] = pow(elements__[offset__(i, j)], v);
       }
     }
     return *this;
   }
 
-  template<typename T>
-  matrix<T> operator-(const matrix<T>& a, const T v)
+  // binary operators take any mix of matrices and views, and return matrices
+
+  template<typename M> struct matrix_traits__ { static const bool value = false; };
+
+  template<typename T> struct matrix_traits__<matrix<T>> {
+    static const bool value = true;
+    using element_t = T;
+  };
+
+  template<typename T> struct matrix_traits__<matrix_view<T>> {
+    static const bool value = true;
+    using element_t = typename remove_const<T>::type;
+  };
+
+  template<typename A, typename B>
+  using matrix_result__ = typename enable_if<
+    matrix_traits__<A>::value && matrix_traits__<B>::value &&
+    is_same<typename matrix_traits__<A>::element_t, typename matrix_traits__<B>::element_t>::value,
+    matrix<typename matrix_traits__<A>::element_t>
+  >::type;
+
+  template<typename A>
+  using scalar_result__ = typename enable_if<
+    matrix_traits__<A>::value,
+    matrix<typename matrix_traits__<A>::element_t>
+  >::type;
+
+  template<typename A>
+  using scalar__ = typename matrix_traits__<A>::element_t;
+
+  template<typename A, typename B>
+  void check_size__(const A& a, const B& b, const char* func)
   {
-    matrix<T> b{a};
-    return b-=v;
+    if ((a.rows()!=b.rows()) || (a.columns()!=b.columns())) {
+      ostringstream str_stream;
+      str_stream << "size mismatch! cannot operate on matrices ("
+        << func << "() in "<< __FILE__<<":"<<__LINE__<<")";
+
+      throw invalid_argument(str_stream.str());
+    }
   }
 
-  template<typename T>
-  matrix<T>& matrix<T>::operator-=(const T v)
+  template<typename A, typename B>
+  matrix_result__<A, B> operator+(const A& a, const B& b)
   {
+    check_size__(a, b, __func__);
 
-    for (size_t i = 0; i < rows(); i++) {
-      for (size_t j = 0; j < columns(); j++) {
-        elements__[offset__(i, j)] -= v;
-      }
-    }
-    return *this;
+    matrix_result__<A, B> c{a};
+    return c+=b;
   }
 
-  template<typename T>
-  matrix<T> operator*(const matrix<T>& a, const T v)
+  template<typename A, typename B>
+  matrix_result__<A, B> operator-(const A& a, const B& b)
   {
-    matrix<T> b{a};
-    return b*=v;
+    check_size__(a, b, __func__);
+
+    matrix_result__<A, B> c{a};
+    return c-=b;
   }
 
-  template<typename T>
-  matrix<T>& matrix<T>::operator*=(const T v)
+  template<typename A, typename B>
+  matrix_result__<A, B> operator*(const A& a, const B& b)
   {
+    check_size__(a, b, __func__);
 
-    for (size_t i = 0; i < rows(); i++) {
-      for (size_t j = 0; j < columns(); j++) {
-        elements__[offset__(i, j)] *= v;
-      }
-    }
-    return *this;
+    matrix_result__<A, B> c{a};
+    return c*=b;
   }
 
-  template<typename T>
-  matrix<T> operator/(const matrix<T>& a, const T v)
+  template<typename A, typename B>
+  matrix_result__<A, B> operator/(const A& a, const B& b)
   {
-    matrix<T> b{a};
-    return b/=v;
+    check_size__(a, b, __func__);
+
+    matrix_result__<A, B> c{a};
+    return c/=b;
   }
 
-  template<typename T>
-  matrix<T>& matrix<T>::operator/=(const T v)
+  template<typename A>
+  scalar_result__<A> operator+(const A& a, const scalar__<A> v)
   {
+    scalar_result__<A> b{a};
+    return b+=v;
+  }
 
-    for (size_t i = 0; i < rows(); i++) {
-      for (size_t j = 0; j < columns(); j++) {
-        elements__[offset__(i, j)] /= v;
-      }
-    }
-    return *this;
+  template<typename A>
+  scalar_result__<A> operator-(const A& a, const scalar__<A> v)
+  {
+    scalar_result__<A> b{a};
+    return b-=v;
   }
 
-  template<typename T>
-  matrix<T> operator^(const matrix<T>& a, const T v)
+  template<typename A>
+  scalar_result__<A> operator*(const A& a, const scalar__<A> v)
   {
-    matrix<T> b{a};
-    return b^=v;
+    scalar_result__<A> b{a};
+    return b*=v;
   }
 
-  template<typename T>
-  matrix<T>& matrix<T>::operator^=(const T v)
+  template<typename A>
+  scalar_result__<A> operator/(const A& a, const scalar__<A> v)
   {
+    scalar_result__<A> b{a};
+    return b/=v;
+  }
 
-    for (size_t i = 0; i < rows(); i++) {
-      for (size_t j = 0; j < columns(); j++) {
-        elements__[offset__(i, j)] = pow(elements__[offset__(i, j)], v);
-      }
-    }
-    return *this;
+  template<typename A>
+  scalar_result__<A> operator^(const A& a, const scalar__<A> v)
+  {
+    scalar_result__<A> b{a};
+    return b^=v;
   }
 
-  template<typename T>
-  matrix<T> operator>(const matrix<T>& a, const T v)
+  template<typename A>
+  scalar_result__<A> operator>(const A& a, const scalar__<A> v)
   {
-    matrix<T> b(a.rows(), a.columns());
+    scalar_result__<A> b(a.rows(), a.columns());
     for (size_t i = 0; i < b.rows(); i++) {
       for (size_t j = 0; j < b.columns(); j++) {
         b[i][j] = a[i][j] > v;
@@ -406,10 +567,10 @@ namespace mat_lib {
     return b;
   }
 
-  template<typename T>
-  matrix<T> operator<(const matrix<T>& a, const T v)
+  template<typename A>
+  scalar_result__<A> operator<(const A& a, const scalar__<A> v)
   {
-    matrix<T> b(a.rows(), a.columns());
+    scalar_result__<A> b(a.rows(), a.columns());
     for (size_t i = 0; i < b.rows(); i++) {
       for (size_t j = 0; j < b.columns(); j++) {
         b[i][j] = a[i][j] < v;
@@ -418,21 +579,16 @@ namespace mat_lib {
     return b;
   }
 
-  template<typename T>
-  matrix<T> operator&(const matrix<T>& a, const matrix<T>& b)
+  template<typename A, typename B>
+  matrix_result__<A, B> operator&(const A& a, const B& b)
   {
-    if ((a.rows()!=b.rows()) || (a.columns()!=b.columns())) {
-      ostringstream str_stream;
-      str_stream << "size mismatch! cannot compare matrices ("
-        << __func__ << "() in "<< __FILE__<<":"<<__LINE__<<")";
+    check_size__(a, b, __func__);
 
-      throw invalid_argument(str_stream.str());
-    }
-    matrix<T> c(a.rows(), a.columns());
+    matrix_result__<A, B> c(a.rows(), a.columns());
 
     for (size_t i = 0; i < a.rows(); i++) {
       for (size_t j = 0; j < a.columns(); j++) {
-        c[i][j] = a[i][j] && a[i][j];
+        c[i][j] = a[i][j] && b[i][j];
       }
     }
 
@@ -0,0 +1,34 @@
+/* check.h
+ * Description: Minimal check macro shared by the in-process tests. A failed
+ * check is reported with its location and counted, the test goes on and
+ * check_report() turns the count into the exit status. Valid C and C++.
+ */
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                   \
+  do {                                                                \
+    if (!(cond)) {                                                    \
+      fprintf(stderr, "[ERROR] %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+      failures++;                                                     \
+    }                                                                 \
+  } while (0)
+
+/* exit status of the test, what names the checks in the summary */
+static int check_report(const char* what)
+{
+  if (failures) {
+    fprintf(stderr, "[ERROR] %d check(s) failed\n", failures);
+    return 1;
+  }
+
+  printf("[INFO] %s checks passed\n", what);
+  return 0;
+}
+
+#endif
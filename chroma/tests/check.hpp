@@ -0,0 +1,17 @@
+// check.hpp
+// Description: CHECK macro of check.h for the C++ tests, plus a helper to
+// check that a callable throws a given exception type
+
+#ifndef CHECK_HPP
+#define CHECK_HPP
+
+#include "check.h"
+
+template<typename E, typename F>
+static bool throws(F f)
+{
+  try { f(); } catch (E&) { return true; } catch (...) {}
+  return false;
+}
+
+#endif
@@ -0,0 +1,201 @@
+// chroma_bench.cpp
+// Description: Per stage timing check of the chroma keying application. The
+// best time of every stage is compared against a baseline recorded on the same
+// machine, and the check fails when a stage exceeds it by more than the budget.
+// The baseline is only written with --record; without one the check is skipped.
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <algorithm>
+
+#include <boost/gil.hpp>
+#include <boost/gil/extension/io/png.hpp>
+#include <boost/gil/extension/numeric/sampler.hpp>
+#include <boost/gil/extension/numeric/resample.hpp>
+
+namespace gil = boost::gil;
+
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+#include "image.hpp"
+#include "matrix.hpp"
+
+using namespace std;
+
+// stages faster than this are not checked, timer noise dominates them
+#define MIN_CHECKED_MS 2.0
+
+// exit status reported to ctest (SKIP_RETURN_CODE) when there is no baseline
+#define SKIP_RETURN_CODE 77
+
+using bench_clock = chrono::steady_clock;
+
+static double elapsed_ms(bench_clock::time_point start)
+{
+  return chrono::duration<double, milli>(bench_clock::now() - start).count();
+}
+
+static map<string, double> read_baseline(string& filename)
+{
+  map<string, double> baseline;
+  ifstream file(filename);
+
+  string stage;
+  double ms;
+  while (file >> stage >> ms) baseline[stage] = ms;
+
+  return baseline;
+}
+
+static void write_baseline(string& filename, vector<pair<string, double>>& timings)
+{
+  ofstream file(filename);
+  for (auto& t : timings) file << t.first << " " << t.second << endl;
+}
+
+int main(int argc, char const *argv[]) {
+
+  try
+  {
+    po::options_description desc("Chroma keying stage timings\n\nAllowed options");
+    desc.add_options()
+      ("help", "produce help message")
+      ("fg", po::value<string>()->required(), "foreground image file (PNG)")
+      ("bg", po::value<string>()->required(), "background image file (PNG)")
+      ("key-color", po::value< vector<int> >()->multitoken()->required(), "key color (RGB)")
+      ("t", po::value<double>()->default_value(1), "threshold")
+      ("repeat", po::value<size_t>()->default_value(5), "runs per stage, the best one is kept")
+      ("baseline", po::value<string>()->required(), "baseline file")
+      ("record", "write the timings to the baseline file instead of checking them")
+      ("budget", po::value<double>()->default_value(50), "allowed slowdown over the baseline (%)")
+      ("o", po::value<string>()->default_value("bench_output.png"), "scratch output file (PNG)")
+    ;
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+
+    if(vm.count("help")) { cout << desc << endl; return 0; }
+
+    po::notify(vm);
+
+    vector<int> key = vm["key-color"].as<vector<int>>();
+    if(key.size() != 3) { cerr << "[ERROR] Expected 3 colour channels" << endl; return 1; }
+    gil::rgb8_pixel_t key_color{(unsigned char) key[0], (unsigned char) key[1], (unsigned char) key[2]};
+
+    string fg_file = vm["fg"].as<string>();
+    string bg_file = vm["bg"].as<string>();
+    string out_file = vm["o"].as<string>();
+    double threshold = vm["t"].as<double>();
+    size_t repeat = max(vm["repeat"].as<size_t>(), (size_t) 1);
+
+    vector<string> stages{"decode", "resample", "distance", "composite", "despill", "encode", "matte", "rgba"};
+    map<string, double> best;
+    for (auto& s : stages) best[s] = 1e300;
+
+    for (size_t r = 0; r < repeat; r++) {
+      gil::rgb8_image_t fg_image, bg_image;
+
+      auto start = bench_clock::now();
+      image_lib::read_image(fg_image, fg_file);
+      image_lib::read_image(bg_image, bg_file);
+      best["decode"] = min(best["decode"], elapsed_ms(start));
+
+      start = bench_clock::now();
+      gil::rgb8_image_t bg_resampled(fg_image.width(), fg_image.height());
+      gil::resize_view(gil::const_view(bg_image), gil::view(bg_resampled), gil::bilinear_sampler());
+      best["resample"] = min(best["resample"], elapsed_ms(start));
+
+      mat_lib::matrix<double> hmat, smat, vmat, dist;
+      start = bench_clock::now();
+      image_lib::key_distance(dist, gil::const_view(fg_image), key_color, hmat, smat, vmat);
+      best["distance"] = min(best["distance"], elapsed_ms(start));
+
+      gil::rgb8_image_t res(fg_image.width(), fg_image.height());
+      start = bench_clock::now();
+      image_lib::composite(gil::view(res), gil::const_view(fg_image), gil::const_view(bg_resampled), dist, threshold, key_color, image_lib::DESPILL_NONE);
+      best["composite"] = min(best["composite"], elapsed_ms(start));
+
+      // composite with spill suppression, on a scratch image to keep res for encode
+      gil::rgb8_image_t res_despill(fg_image.width(), fg_image.height());
+      start = bench_clock::now();
+      image_lib::composite(gil::view(res_despill), gil::const_view(fg_image), gil::const_view(bg_resampled), dist, threshold, key_color, image_lib::DESPILL_AVERAGE);
+      best["despill"] = min(best["despill"], elapsed_ms(start));
+
+      start = bench_clock::now();
+      image_lib::write_image(res, out_file);
+      best["encode"] = min(best["encode"], elapsed_ms(start));
+
+      // background free output modes, to compare with resample + composite
+      gil::gray8_image_t res_matte(fg_image.width(), fg_image.height());
+      start = bench_clock::now();
+      image_lib::matte(gil::view(res_matte), dist, threshold);
+      best["matte"] = min(best["matte"], elapsed_ms(start));
+
+      gil::rgba8_image_t res_rgba(fg_image.width(), fg_image.height());
+      start = bench_clock::now();
+      image_lib::matte_rgba(gil::view(res_rgba), gil::const_view(fg_image), dist, threshold, key_color, image_lib::DESPILL_NONE);
+      best["rgba"] = min(best["rgba"], elapsed_ms(start));
+    }
+
+    vector<pair<string, double>> timings;
+    for (auto& s : stages) timings.push_back({s, best[s]});
+
+    string baseline_file = vm["baseline"].as<string>();
+
+    if (vm.count("record")) {
+      write_baseline(baseline_file, timings);
+      for (auto& t : timings) cout << "[INFO] " << t.first << ": " << t.second << " ms" << endl;
+      cout << "[INFO] Baseline recorded in " << baseline_file << endl;
+      return 0;
+    }
+
+    map<string, double> baseline = read_baseline(baseline_file);
+
+    if (baseline.empty()) {
+      for (auto& t : timings) cout << "[INFO] " << t.first << ": " << t.second << " ms" << endl;
+      cout << "[SKIP] No baseline in " << baseline_file
+           << " (record one with --record or the update_perf_baseline target)" << endl;
+      return SKIP_RETURN_CODE;
+    }
+
+    double budget = vm["budget"].as<double>();
+    bool regressed = false;
+
+    for (auto& t : timings) {
+      cout << "[INFO] " << t.first << ": " << t.second << " ms";
+
+      auto b = baseline.find(t.first);
+      if (b == baseline.end()) { cout << " (no baseline)" << endl; continue; }
+
+      double change = 100.0 * (t.second - b->second) / b->second;
+      cout << " (baseline " << b->second << " ms, " << (change >= 0 ? "+" : "") << change << "%)";
+
+      if (change > budget && t.second > MIN_CHECKED_MS) {
+        cout << " REGRESSION";
+        regressed = true;
+      }
+      cout << endl;
+    }
+
+    if (regressed) {
+      cerr << "[ERROR] Stage timings exceed the " << budget << "% budget over "
+           << baseline_file << " (update_perf_baseline records a new one)" << endl;
+      return 1;
+    }
+
+    return 0;
+
+  } catch(exception& e) {
+    cerr << "[ERROR] " << e.what() << endl;
+  } catch(...) {
+    cerr << "Unknown exception!" << endl;
+  }
+
+  return 1;
+}
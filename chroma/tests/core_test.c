@@ -0,0 +1,181 @@
+/* core_test.c
+ * Description: In-process test of the chroma_core C interface, keying frames
+ * held in memory without any file I/O.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chroma_core.h"
+#include "check.h"
+
+#define W 4
+#define H 3
+#define PAD 5
+
+static void set_px(uint8_t* row, size_t x, uint8_t r, uint8_t g, uint8_t b)
+{
+  row[3*x] = r; row[3*x+1] = g; row[3*x+2] = b;
+}
+
+int main(void)
+{
+  /* foreground with padded rows: green backing and a red subject */
+  size_t fg_stride = 3*W + PAD;
+  uint8_t fg[H*(3*W + PAD)];
+  memset(fg, 0xaa, sizeof(fg));
+
+  for (size_t y = 0; y < H; y++)
+    for (size_t x = 0; x < W; x++) {
+      uint8_t* row = fg + y*fg_stride;
+      if (x == 1 || x == 2) set_px(row, x, 200, 30, 30);
+      else                  set_px(row, x, 10, 240, 20);
+    }
+
+  /* packed blue background */
+  size_t bg_stride = 3*W;
+  uint8_t bg[H*3*W];
+  for (size_t y = 0; y < H; y++)
+    for (size_t x = 0; x < W; x++)
+      set_px(bg + y*bg_stride, x, 0, 0, 255);
+
+  uint8_t out[H*3*W];
+  uint8_t out2[H*3*W];
+
+  chroma_ctx* ctx = chroma_ctx_create();
+  CHECK(ctx != NULL);
+  if (!ctx) return 1;
+
+  CHECK(chroma_set_key_color(ctx, 0, 255, 0) == CHROMA_OK);
+  CHECK(chroma_set_threshold(ctx, 1.5) == CHROMA_OK);
+
+  /* one shot keying */
+  CHECK(chroma_key_frame(ctx, fg, fg_stride, bg, bg_stride, out, W, H) == CHROMA_OK);
+
+  for (size_t y = 0; y < H; y++)
+    for (size_t x = 0; x < W; x++) {
+      const uint8_t* px = out + 3*(y*W + x);
+      const uint8_t* expected = (x == 1 || x == 2) ? fg + y*fg_stride + 3*x : bg + y*bg_stride + 3*x;
+      CHECK(memcmp(px, expected, 3) == 0);
+    }
+
+  /* a second frame reuses the context */
+  memset(out2, 0, sizeof(out2));
+  CHECK(chroma_key_frame(ctx, fg, fg_stride, bg, bg_stride, out2, W, H) == CHROMA_OK);
+  CHECK(memcmp(out, out2, sizeof(out)) == 0);
+
+  /* two step keying matches the one shot */
+  memset(out2, 0, sizeof(out2));
+  CHECK(chroma_compute_distance(ctx, fg, fg_stride, W, H) == CHROMA_OK);
+  CHECK(chroma_composite(ctx, fg, fg_stride, bg, bg_stride, out2, W, H) == CHROMA_OK);
+  CHECK(memcmp(out, out2, sizeof(out)) == 0);
+
+  /* quantized distance round trip */
+  uint16_t map[H*W];
+  CHECK(chroma_get_distance(ctx, map, W, H) == CHROMA_OK);
+
+  chroma_ctx* ctx2 = chroma_ctx_create();
+  CHECK(ctx2 != NULL);
+  if (ctx2) {
+    CHECK(chroma_set_threshold(ctx2, 1.5) == CHROMA_OK);
+    CHECK(chroma_set_distance(ctx2, map, W, H) == CHROMA_OK);
+    memset(out2, 0, sizeof(out2));
+    CHECK(chroma_composite(ctx2, fg, fg_stride, bg, bg_stride, out2, W, H) == CHROMA_OK);
+    CHECK(memcmp(out, out2, sizeof(out)) == 0);
+    chroma_ctx_destroy(ctx2);
+  }
+
+  /* matte and rgba output of the kept distance map, without background */
+  uint8_t matte[H*W];
+  uint8_t rgba[H*4*W];
+  CHECK(chroma_compute_distance(ctx, fg, fg_stride, W, H) == CHROMA_OK);
+  CHECK(chroma_matte(ctx, matte, W, H) == CHROMA_OK);
+  CHECK(chroma_matte_rgba(ctx, fg, fg_stride, rgba, W, H) == CHROMA_OK);
+
+  for (size_t y = 0; y < H; y++)
+    for (size_t x = 0; x < W; x++) {
+      uint8_t alpha = (x == 1 || x == 2) ? 255 : 0;
+      const uint8_t* px = rgba + 4*(y*W + x);
+      CHECK(matte[y*W + x] == alpha);
+      CHECK(memcmp(px, fg + y*fg_stride + 3*x, 3) == 0 && px[3] == alpha);
+    }
+
+  /* black pixels have no distance, kept through the reserved code */
+  uint8_t black[3] = {0, 0, 0};
+  uint8_t white[3] = {255, 255, 255};
+  uint8_t black_out[3];
+  uint16_t black_map[1];
+  CHECK(chroma_compute_distance(ctx, black, 3, 1, 1) == CHROMA_OK);
+  CHECK(chroma_get_distance(ctx, black_map, 1, 1) == CHROMA_OK);
+  CHECK(black_map[0] == 65535);
+  CHECK(chroma_set_distance(ctx, black_map, 1, 1) == CHROMA_OK);
+  memset(black_out, 0xff, sizeof(black_out));
+  CHECK(chroma_composite(ctx, black, 3, white, 3, black_out, 1, 1) == CHROMA_OK);
+  CHECK(black_out[0] == 0 && black_out[1] == 0 && black_out[2] == 0);
+
+  /* despill of a foreground pixel with green spill */
+  uint8_t spill_fg[3*W];
+  uint8_t spill_bg[3*W];
+  uint8_t spill_out[3*W];
+  memset(spill_bg, 0, sizeof(spill_bg));
+  for (size_t x = 0; x < W; x++) set_px(spill_fg, x, 200, 150, 100);
+
+  CHECK(chroma_set_despill(ctx, CHROMA_DESPILL_AVERAGE) == CHROMA_OK);
+  CHECK(chroma_key_frame(ctx, spill_fg, sizeof(spill_fg), spill_bg, sizeof(spill_bg), spill_out, W, 1) == CHROMA_OK);
+  CHECK(spill_out[0] == 200 && spill_out[1] == 150 && spill_out[2] == 100);
+
+  for (size_t x = 0; x < W; x++) set_px(spill_fg, x, 200, 230, 100);
+  CHECK(chroma_key_frame(ctx, spill_fg, sizeof(spill_fg), spill_bg, sizeof(spill_bg), spill_out, W, 1) == CHROMA_OK);
+  CHECK(spill_out[0] == 200 && spill_out[1] == 150 && spill_out[2] == 100);
+
+  uint8_t spill_rgba[4*W];
+  CHECK(chroma_matte_rgba(ctx, spill_fg, sizeof(spill_fg), spill_rgba, W, 1) == CHROMA_OK);
+  CHECK(spill_rgba[0] == 200 && spill_rgba[1] == 150 && spill_rgba[2] == 100 && spill_rgba[3] == 255);
+
+  CHECK(chroma_set_despill(ctx, CHROMA_DESPILL_MAX) == CHROMA_OK);
+  CHECK(chroma_key_frame(ctx, spill_fg, sizeof(spill_fg), spill_bg, sizeof(spill_bg), spill_out, W, 1) == CHROMA_OK);
+  CHECK(spill_out[0] == 200 && spill_out[1] == 200 && spill_out[2] == 100);
+
+  CHECK(chroma_set_despill(ctx, CHROMA_DESPILL_NONE) == CHROMA_OK);
+
+  /* key color estimate: green backing around a red subject */
+  uint8_t scene[8*8*3];
+  for (size_t i = 0; i < 8*8; i++) set_px(scene, i, 10, 240, 20);
+  for (size_t y = 3; y < 5; y++)
+    for (size_t x = 3; x < 5; x++) set_px(scene + y*3*8, x, 200, 30, 30);
+
+  double confidence = 0;
+  uint8_t red = 0, green = 0, blue = 0;
+  CHECK(chroma_estimate_key_color(ctx, scene, 3*8, 8, 8, 1, &confidence) == CHROMA_OK);
+  CHECK(chroma_get_key_color(ctx, &red, &green, &blue) == CHROMA_OK);
+  CHECK(red == 10 && green == 240 && blue == 20);
+  CHECK(confidence > 0.9 && confidence <= 1.0);
+
+  /* grey frames have no key color */
+  memset(scene, 128, sizeof(scene));
+  CHECK(chroma_estimate_key_color(ctx, scene, 3*8, 8, 8, 1, NULL) == CHROMA_ERROR);
+  CHECK(chroma_estimate_key_color(ctx, scene, 3*8, 8, 8, 0, NULL) == CHROMA_INVALID_ARGUMENT);
+  CHECK(chroma_get_key_color(ctx, &red, &green, &blue) == CHROMA_OK);
+  CHECK(red == 10 && green == 240 && blue == 20);
+
+  CHECK(chroma_set_key_color(ctx, 0, 255, 0) == CHROMA_OK);
+
+  /* errors */
+  CHECK(chroma_set_threshold(ctx, -1.0) == CHROMA_INVALID_ARGUMENT);
+  CHECK(chroma_set_despill(ctx, 7) == CHROMA_INVALID_ARGUMENT);
+  CHECK(strlen(chroma_last_error(ctx)) > 0);
+  CHECK(chroma_key_frame(ctx, fg, 3*W - 1, bg, bg_stride, out, W, H) == CHROMA_INVALID_ARGUMENT);
+  CHECK(chroma_key_frame(ctx, NULL, fg_stride, bg, bg_stride, out, W, H) == CHROMA_INVALID_ARGUMENT);
+  CHECK(chroma_composite(ctx, fg, fg_stride, bg, bg_stride, out, W - 1, H) == CHROMA_INVALID_ARGUMENT);
+  CHECK(chroma_matte(ctx, NULL, W, H) == CHROMA_INVALID_ARGUMENT);
+  CHECK(chroma_matte_rgba(ctx, fg, fg_stride, rgba, W, H + 1) == CHROMA_INVALID_ARGUMENT);
+  CHECK(chroma_key_frame(NULL, fg, fg_stride, bg, bg_stride, out, W, H) == CHROMA_INVALID_ARGUMENT);
+
+  CHECK(chroma_key_frame(ctx, fg, fg_stride, bg, bg_stride, out, W, H) == CHROMA_OK);
+  CHECK(strlen(chroma_last_error(ctx)) == 0);
+
+  chroma_ctx_destroy(ctx);
+
+  return check_report("chroma_core in-process");
+}
@@ -0,0 +1,223 @@
+// golden_check.cpp
+// Description: Golden image check of the chroma keying application. A golden
+// is the 8 bit key decision of a foreground (255 foreground, 0 background,
+// 128 black on the threshold); the expected composite of any background is
+// rebuilt from it and compared pixel by pixel against the chroma output. A
+// matte output is compared against the decision itself.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <boost/gil.hpp>
+#include <boost/gil/extension/io/png.hpp>
+#include <boost/gil/extension/numeric/sampler.hpp>
+#include <boost/gil/extension/numeric/resample.hpp>
+
+namespace gil = boost::gil;
+
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+#include "image.hpp"
+#include "matrix.hpp"
+
+using namespace std;
+
+#define GOLDEN_FG 255
+#define GOLDEN_BG 0
+#define GOLDEN_ON 128
+
+static int write_golden(string& fg_file, vector<int>& key, double threshold, string& golden_file)
+{
+  gil::rgb8_image_t fg_image;
+  image_lib::read_image(fg_image, fg_file);
+
+  gil::rgb8_pixel_t key_color{(unsigned char) key[0], (unsigned char) key[1], (unsigned char) key[2]};
+
+  mat_lib::matrix<double> hmat, smat, vmat, dist;
+  image_lib::key_distance(dist, gil::const_view(fg_image), key_color, hmat, smat, vmat);
+
+  gil::gray8_image_t golden(fg_image.width(), fg_image.height());
+  gil::gray8_view_t vw = gil::view(golden);
+
+  for (size_t h = 0; h < dist.rows(); h++) {
+    auto iter = vw.row_begin(h);
+    for (size_t w = 0; w < dist.columns(); w++) {
+      double d = dist[h][w];
+      *iter = gil::gray8_pixel_t(d > threshold ? GOLDEN_FG : (d < threshold ? GOLDEN_BG : GOLDEN_ON));
+      iter++;
+    }
+  }
+
+  gil::write_view(golden_file, gil::const_view(golden), gil::png_tag());
+  cout << "[INFO] Golden written to " << golden_file << endl;
+  return 0;
+}
+
+static int check_golden(string& fg_file, string& bg_file, string& golden_file, string& actual_file,
+                        double max_diff)
+{
+  gil::rgb8_image_t fg_image, bg_image, actual;
+  image_lib::read_image(fg_image, fg_file);
+  image_lib::read_image(bg_image, bg_file);
+  image_lib::read_image(actual, actual_file);
+
+  gil::gray8_image_t golden;
+  gil::read_image(golden_file, golden, gil::png_tag());
+
+  if (golden.dimensions() != fg_image.dimensions() || actual.dimensions() != fg_image.dimensions()) {
+    cerr << "[ERROR] Size mismatch: fg " << fg_image.width() << "x" << fg_image.height()
+         << ", golden " << golden.width() << "x" << golden.height()
+         << ", output " << actual.width() << "x" << actual.height() << endl;
+    return 1;
+  }
+
+  // reference background, resampled as the application does
+  gil::rgb8_image_t bg_resampled(fg_image.width(), fg_image.height());
+  gil::resize_view(gil::const_view(bg_image), gil::view(bg_resampled), gil::bilinear_sampler());
+
+  gil::rgb8c_view_t fg_vw = gil::const_view(fg_image);
+  gil::rgb8c_view_t bg_vw = gil::const_view(bg_resampled);
+  gil::rgb8c_view_t out_vw = gil::const_view(actual);
+  gil::gray8c_view_t gd_vw = gil::const_view(golden);
+
+  size_t width = fg_image.width(), height = fg_image.height();
+  size_t n_fg = 0, n_bg = 0, n_on = 0, n_diff = 0;
+  size_t x0 = width, y0 = height, x1 = 0, y1 = 0;
+  int max_delta = 0;
+
+  for (size_t h = 0; h < height; h++) {
+    for (size_t w = 0; w < width; w++) {
+      unsigned char g = gd_vw(w, h);
+
+      gil::rgb8_pixel_t expected;
+      if (g == GOLDEN_FG)      { expected = fg_vw(w, h); n_fg++; }
+      else if (g == GOLDEN_BG) { expected = bg_vw(w, h); n_bg++; }
+      else                     { expected = gil::rgb8_pixel_t{0, 0, 0}; n_on++; }
+
+      gil::rgb8_pixel_t got = out_vw(w, h);
+      if (got == expected) continue;
+
+      n_diff++;
+      x0 = min(x0, w); y0 = min(y0, h);
+      x1 = max(x1, w); y1 = max(y1, h);
+      for (int c = 0; c < 3; c++)
+        max_delta = max(max_delta, abs((int) got[c] - (int) expected[c]));
+    }
+  }
+
+  double total = (double) width * height;
+  cout << "[INFO] " << actual_file << ": " << width << "x" << height << endl
+       << "[INFO] coverage: foreground " << 100.0 * n_fg / total << "%, background "
+       << 100.0 * n_bg / total << "%, on threshold " << 100.0 * n_on / total << "%" << endl
+       << "[INFO] differing pixels: " << n_diff << " (" << 100.0 * n_diff / total << "%)" << endl;
+
+  if (n_bg == 0 || n_fg == 0)
+    cout << "[WARNING] golden only exercises one side of the key" << endl;
+
+  if (100.0 * n_diff / total > max_diff) {
+    cerr << "[ERROR] output differs from golden in [" << x0 << ", " << x1 << "] x ["
+         << y0 << ", " << y1 << "], max channel delta " << max_delta << endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+// a matte keeps the foreground decisions only, the threshold itself is 0
+static int check_matte(string& golden_file, string& actual_file)
+{
+  gil::gray8_image_t golden, actual;
+  gil::read_image(golden_file, golden, gil::png_tag());
+  gil::read_image(actual_file, actual, gil::png_tag());
+
+  if (actual.dimensions() != golden.dimensions()) {
+    cerr << "[ERROR] Size mismatch: golden " << golden.width() << "x" << golden.height()
+         << ", matte " << actual.width() << "x" << actual.height() << endl;
+    return 1;
+  }
+
+  gil::gray8c_view_t gd_vw = gil::const_view(golden);
+  gil::gray8c_view_t out_vw = gil::const_view(actual);
+
+  size_t width = golden.width(), height = golden.height();
+  size_t n_diff = 0;
+
+  for (size_t h = 0; h < height; h++) {
+    for (size_t w = 0; w < width; w++) {
+      unsigned char expected = (gd_vw(w, h) == GOLDEN_FG) ? 255 : 0;
+      if (out_vw(w, h) != expected) n_diff++;
+    }
+  }
+
+  cout << "[INFO] " << actual_file << ": " << width << "x" << height << endl
+       << "[INFO] differing pixels: " << n_diff << " (" << 100.0 * n_diff / ((double) width * height) << "%)" << endl;
+
+  if (n_diff) {
+    cerr << "[ERROR] matte differs from golden" << endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+int main(int argc, char const *argv[]) {
+
+  try
+  {
+    po::options_description desc("Golden image check\n\nAllowed options");
+    desc.add_options()
+      ("help", "produce help message")
+      ("fg", po::value<string>()->required(), "foreground image file (PNG)")
+      ("bg", po::value<string>(), "background image file (PNG)")
+      ("golden", po::value<string>()->required(), "golden key decision (8 bit PNG)")
+      ("output", po::value<string>(), "chroma output to check (PNG)")
+      ("write-golden", "write the golden from --key-color and --t instead of checking")
+      ("key-color", po::value< vector<int> >()->multitoken(), "key color (RGB)")
+      ("t", po::value<double>()->default_value(1), "threshold")
+      ("matte", "check a matte output (--output-mode matte), no background needed")
+      ("max-diff", po::value<double>()->default_value(0), "allowed differing pixels (%)")
+    ;
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+
+    if(vm.count("help")) { cout << desc << endl; return 0; }
+
+    po::notify(vm);
+
+    string fg_file = vm["fg"].as<string>();
+    string golden_file = vm["golden"].as<string>();
+
+    if(vm.count("write-golden")) {
+      vector<int> key;
+      if(vm.count("key-color")) key = vm["key-color"].as<vector<int>>();
+      if(key.size() != 3) { cerr << "[ERROR] Expected 3 colour channels" << endl; return 1; }
+
+      return write_golden(fg_file, key, vm["t"].as<double>(), golden_file);
+    }
+
+    if(vm.count("matte")) {
+      if(!vm.count("output")) { cerr << "[ERROR] --output is required" << endl; return 1; }
+
+      string actual_file = vm["output"].as<string>();
+      return check_matte(golden_file, actual_file);
+    }
+
+    if(!vm.count("bg") || !vm.count("output")) { cerr << "[ERROR] --bg and --output are required" << endl; return 1; }
+
+    string bg_file = vm["bg"].as<string>();
+    string actual_file = vm["output"].as<string>();
+    return check_golden(fg_file, bg_file, golden_file, actual_file, vm["max-diff"].as<double>());
+
+  } catch(exception& e) {
+    cerr << "[ERROR] " << e.what() << endl;
+  } catch(...) {
+    cerr << "Unknown exception!" << endl;
+  }
+
+  return 1;
+}
@@ -0,0 +1,71 @@
+// matrix_test.cpp
+// Description: Checks of mat_lib::matrix storage and of mat_lib::matrix_view
+// slicing, operators and error handling
+
+#include <stdexcept>
+#include <cstdint>
+
+#include "matrix.hpp"
+#include "check.hpp"
+
+using namespace std;
+
+int main()
+{
+  // aligned, padded rows
+  mat_lib::matrix<double> m(5, 7);
+  CHECK(m.stride() % 8 == 0 && m.stride() >= 7);
+  for (size_t i = 0; i < m.rows(); i++) {
+    CHECK((uintptr_t) m[i] % MATRIX_ALIGNMENT == 0);
+    for (size_t j = 0; j < m.columns(); j++) m[i][j] = 10.0*i + j;
+  }
+
+  // at() is bounds checked
+  CHECK(m.at(4, 6) == 46.0);
+  CHECK(throws<out_of_range>([&]() { m.at(5, 0); }));
+
+  // copy assignment reshapes same-size matrices
+  mat_lib::matrix<double> t(7, 5);
+  t = m;
+  CHECK(t.rows() == 5 && t.columns() == 7 && t.at(3, 6) == 36.0);
+
+  // slicing without copies
+  mat_lib::matrix_view<double> v = m.view(1, 2, 3, 4);
+  CHECK(v.rows() == 3 && v.columns() == 4 && v.stride() == m.stride());
+  CHECK(v[0] == &m[1][2] && v.at(2, 3) == 35.0);
+  CHECK(v.view(1, 1, 2, 2).at(0, 0) == 23.0);
+  CHECK(throws<out_of_range>([&]() { m.view(3, 0, 3, 1); }));
+
+  // in-place operators on a slice leave the rest untouched
+  v += 100.0;
+  CHECK(m.at(1, 2) == 112.0 && m.at(3, 5) == 135.0);
+  CHECK(m.at(0, 2) == 2.0 && m.at(1, 1) == 11.0 && m.at(4, 6) == 46.0);
+
+  // binary operators mix matrices and views
+  mat_lib::matrix<double> ones(3, 4);
+  ones.view() *= 0.0;
+  ones += 1.0;
+
+  mat_lib::matrix<double> s = v + ones;
+  CHECK(s.rows() == 3 && s.columns() == 4 && s.at(0, 0) == 113.0);
+
+  mat_lib::matrix<double> d = ones - v;
+  CHECK(d.at(2, 3) == -134.0);
+
+  mat_lib::matrix_view<const double> cv = v;
+  mat_lib::matrix<double> p = (cv * 2.0) / ones;
+  CHECK(p.at(1, 1) == 246.0);
+  CHECK((cv > 120.0).at(0, 0) == 0.0 && (cv > 120.0).at(1, 0) == 1.0);
+  CHECK(((cv - 200.0).abs()).at(0, 0) == 88.0);
+  CHECK(cv.min(ones).at(2, 2) == 1.0);
+  CHECK(((ones > 0.0) & (cv > 120.0)).at(0, 1) == 0.0);
+
+  CHECK(throws<invalid_argument>([&]() { m + ones; }));
+  CHECK(throws<invalid_argument>([&]() { ones += m.view(0, 0, 2, 4); }));
+
+  // views survive moves of their matrix
+  mat_lib::matrix<double> moved{std::move(m)};
+  CHECK(v[0] == &moved[1][2] && m.size() == 0 && m.view().size() == 0);
+
+  return check_report("matrix");
+}
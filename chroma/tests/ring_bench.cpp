@@ -0,0 +1,204 @@
+// ring_bench.cpp
+// Description: Local producer / consumer check of the shared memory ingestion
+// of the chroma keying application. It renders synthetic green screen frames
+// straight into an input frame ring, runs chroma on that ring as a separate
+// process, reads the keyed frames back from the output ring (or from the input
+// ring when keying in place) and reports per frame latency percentiles.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+#include "frame_ring.hpp"
+
+using namespace std;
+
+// synthetic frames: green backing with a red square moving along the rows
+#define SQUARE 32
+
+static void render(uint8_t* pixels, size_t stride, size_t width, size_t height, uint64_t sequence)
+{
+  size_t x0 = (sequence * 4) % (width - SQUARE);
+  size_t y0 = (height - SQUARE) / 2;
+
+  for (size_t h = 0; h < height; h++) {
+    uint8_t* row = pixels + h * stride;
+    for (size_t w = 0; w < width; w++) {
+      bool square = (w >= x0 && w < x0 + SQUARE && h >= y0 && h < y0 + SQUARE);
+      row[3*w]   = square ? 200 : 10;
+      row[3*w+1] = square ? 30 : 240;
+      row[3*w+2] = square ? 30 : 20;
+    }
+  }
+}
+
+static double percentile(vector<double>& sorted, double p)
+{
+  size_t i = min(sorted.size() - 1, (size_t) (p / 100.0 * sorted.size()));
+  return sorted[i];
+}
+
+int main(int argc, char const *argv[]) {
+
+  pid_t child = -1;
+
+  try
+  {
+    po::options_description desc("Frame ring producer / consumer\n\nAllowed options");
+    desc.add_options()
+      ("help", "produce help message")
+      ("chroma", po::value<string>()->required(), "chroma executable")
+      ("bg", po::value<string>()->required(), "background image file (PNG)")
+      ("width", po::value<size_t>()->default_value(320), "frame width")
+      ("height", po::value<size_t>()->default_value(180), "frame height")
+      ("frames", po::value<size_t>()->default_value(60), "frames to produce")
+      ("slots", po::value<size_t>()->default_value(4), "slots per ring")
+      ("fps", po::value<double>()->default_value(30), "capture rate (0 for as fast as possible)")
+      ("in-place", "key the frames in the input ring instead of an output ring")
+    ;
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+
+    if(vm.count("help")) { cout << desc << endl; return 0; }
+
+    po::notify(vm);
+
+    size_t width = vm["width"].as<size_t>(), height = vm["height"].as<size_t>();
+    size_t frames = vm["frames"].as<size_t>();
+    size_t slots = vm["slots"].as<size_t>();
+    double fps = vm["fps"].as<double>();
+    bool in_place = vm.count("in-place");
+
+    if(width <= SQUARE || height <= SQUARE || frames == 0)
+      { cerr << "[ERROR] Frames must be larger than " << SQUARE << "x" << SQUARE << endl; return 1; }
+
+    string in_name = "/chroma_ring_in_" + to_string(getpid());
+    string out_name = "/chroma_ring_out_" + to_string(getpid());
+
+    ring_lib::frame_ring in = ring_lib::frame_ring::create(in_name, width, height, 3, slots, in_place ? 3 : 2);
+    unique_ptr<ring_lib::frame_ring> out;
+    if(!in_place) out.reset(new ring_lib::frame_ring(ring_lib::frame_ring::create(out_name, width, height, 3, slots, 2)));
+
+    // chroma as a separate process, attached to the rings
+    vector<string> args{vm["chroma"].as<string>(),
+                        "--ring-in", in_name,
+                        "--bg", vm["bg"].as<string>(),
+                        "--key-color", "10", "240", "20",
+                        "--t", "1.5"};
+    if(!in_place) { args.push_back("--ring-out"); args.push_back(out_name); }
+
+    child = fork();
+    if(child < 0) { cerr << "[ERROR] Cannot fork" << endl; return 1; }
+    if(child == 0) {
+      vector<char*> argv_child;
+      for(auto& a : args) argv_child.push_back(const_cast<char*>(a.c_str()));
+      argv_child.push_back(nullptr);
+      execv(argv_child[0], argv_child.data());
+      _exit(127);
+    }
+
+    // chroma stages are closed when it exits, so that a crash cannot leave
+    // the producer or the consumer waiting forever
+    int status = 0;
+    thread watcher([&]() {
+      waitpid(child, &status, 0);
+      in.close(1);
+      if(out) out->close(0);
+    });
+
+    // consumer: last stage of the ring holding the keyed frames
+    ring_lib::frame_ring& keyed = in_place ? in : *out;
+    size_t keyed_stage = in_place ? 2 : 1;
+
+    vector<double> latencies;
+    size_t out_of_order = 0, bad_pixels = 0;
+
+    thread consumer([&]() {
+      ring_lib::frame_slot_header* slot;
+      uint64_t expected = 0;
+
+      while(uint8_t* pixels = keyed.acquire(keyed_stage, slot)) {
+        latencies.push_back((ring_lib::monotonic_ns() - slot->timestamp_ns) / 1e6);
+        if(slot->sequence != expected) out_of_order++;
+        expected = slot->sequence + 1;
+
+        // the square is kept, the backing is replaced
+        size_t x0 = (slot->sequence * 4) % (width - SQUARE);
+        size_t y0 = (height - SQUARE) / 2;
+        const uint8_t* inside = pixels + (y0 + SQUARE/2) * keyed.row_stride() + 3 * (x0 + SQUARE/2);
+        const uint8_t* corner = pixels;
+        if(inside[0] != 200 || inside[1] != 30 || inside[2] != 30) bad_pixels++;
+        if(corner[0] == 10 && corner[1] == 240 && corner[2] == 20) bad_pixels++;
+
+        keyed.release(keyed_stage);
+      }
+      keyed.close(keyed_stage);
+    });
+
+    // producer: renders in place into the slots, capture rate permitting
+    auto period = chrono::duration<double>(fps > 0 ? 1.0 / fps : 0.0);
+    auto next = chrono::steady_clock::now();
+    ring_lib::frame_slot_header* slot;
+
+    for(uint64_t sequence = 0; sequence < frames; sequence++) {
+      if(fps > 0) { this_thread::sleep_until(next); next += chrono::duration_cast<chrono::steady_clock::duration>(period); }
+
+      uint8_t* pixels = in.acquire(0, slot);
+      if(!pixels) break;
+
+      render(pixels, in.row_stride(), width, height, sequence);
+      slot->sequence = sequence;
+      slot->timestamp_ns = ring_lib::monotonic_ns();
+      in.release(0);
+    }
+    in.close(0);
+
+    watcher.join();
+    child = -1;
+    consumer.join();
+
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      { cerr << "[ERROR] chroma failed on the frame ring" << endl; return 1; }
+
+    if(latencies.empty()) { cerr << "[ERROR] No keyed frames" << endl; return 1; }
+
+    vector<double> sorted = latencies;
+    sort(sorted.begin(), sorted.end());
+
+    cout << "[INFO] " << (in_place ? "in place" : "output ring") << ", "
+         << width << "x" << height << ", " << latencies.size() << "/" << frames << " frames" << endl
+         << "[INFO] latency (ms): p50 " << percentile(sorted, 50)
+         << ", p90 " << percentile(sorted, 90)
+         << ", p99 " << percentile(sorted, 99)
+         << ", max " << sorted.back() << endl;
+
+    if(latencies.size() != frames || out_of_order || bad_pixels) {
+      cerr << "[ERROR] " << frames - latencies.size() << " lost, " << out_of_order
+           << " out of order and " << bad_pixels << " badly keyed frames" << endl;
+      return 1;
+    }
+
+    return 0;
+
+  } catch(exception& e) {
+    cerr << "[ERROR] " << e.what() << endl;
+  } catch(...) {
+    cerr << "Unknown exception!" << endl;
+  }
+
+  if(child > 0) { kill(child, SIGTERM); waitpid(child, nullptr, 0); }
+  return 1;
+}
@@ -0,0 +1,145 @@
+// ring_test.cpp
+// Description: Checks of ring_lib::frame_ring attaching to malformed headers
+// written by another process, and of its stage bounds. Given the chroma
+// executable, also checks that chroma exits with an error on those rings
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <system_error>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "frame_ring.hpp"
+#include "check.hpp"
+
+using namespace std;
+
+// exit status of chroma keying the given input ring, -1 if it did not exit
+static int run_chroma(const string& chroma, const string& ring_in)
+{
+  vector<string> args{chroma, "--ring-in", ring_in, "--ring-out", ring_in + "_out",
+                      "--output-mode", "matte", "--key-color", "0", "254", "0"};
+  vector<char*> argv_child;
+  for (auto& a : args) argv_child.push_back(&a[0]);
+  argv_child.push_back(nullptr);
+
+  pid_t child = fork();
+  if (child < 0) return -1;
+  if (child == 0) {
+    execv(argv_child[0], argv_child.data());
+    _exit(127);
+  }
+
+  int status;
+  if (waitpid(child, &status, 0) < 0 || !WIFEXITED(status)) return -1;
+  return WEXITSTATUS(status);
+}
+
+int main(int argc, char const *argv[])
+{
+  string chroma = (argc > 1) ? argv[1] : "";
+  string name = "/chroma_ring_test_" + to_string(getpid());
+  ring_lib::frame_ring ring = ring_lib::frame_ring::create(name, 16, 8, 3, 2, 2);
+
+  // a taken name is only replaced on request
+  auto create_taken = [&]() { ring_lib::frame_ring::create(name, 16, 8, 3, 2, 2); };
+  CHECK(throws<system_error>(create_taken));
+  try { create_taken(); } catch (system_error& e) { CHECK(e.code().value() == EEXIST); }
+
+  string stale = name + "_stale";
+  int stale_fd = shm_open(stale.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  CHECK(stale_fd >= 0);
+  if (stale_fd >= 0) close(stale_fd);
+  CHECK(!throws<exception>([&]() { ring_lib::frame_ring::create(stale, 16, 8, 3, 2, 2, true); }));
+
+  // the header as another process sees it
+  int fd = shm_open(name.c_str(), O_RDWR, 0);
+  CHECK(fd >= 0);
+  if (fd < 0) return 1;
+  void* memory = mmap(nullptr, sizeof(ring_lib::frame_ring_header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  CHECK(memory != MAP_FAILED);
+  if (memory == MAP_FAILED) return 1;
+  ring_lib::frame_ring_header* header = static_cast<ring_lib::frame_ring_header*>(memory);
+  const ring_lib::frame_ring_header good = {header->magic, header->version, header->width,
+                                            header->height, header->channels, header->slots,
+                                            header->stages, header->row_stride, header->slot_size,
+                                            header->frames_offset, {}};
+
+  auto attach = [&]() { ring_lib::frame_ring::attach(name); };
+  auto restore = [&]() {
+    header->width = good.width; header->height = good.height;
+    header->channels = good.channels; header->slots = good.slots;
+    header->stages = good.stages; header->row_stride = good.row_stride;
+    header->slot_size = good.slot_size; header->frames_offset = good.frames_offset;
+  };
+
+  CHECK(!throws<exception>(attach));
+
+  // rows narrower than a frame row
+  header->row_stride = good.width * good.channels - 1;
+  CHECK(throws<runtime_error>(attach));
+  restore();
+
+  // slots smaller than their frame
+  header->slot_size = good.row_stride * good.height;
+  CHECK(throws<runtime_error>(attach));
+  restore();
+
+  // frames larger than their slots
+  header->height = good.height + 1;
+  CHECK(throws<runtime_error>(attach));
+  restore();
+
+  // more slots than the mapping holds, or so many that the size overflows
+  header->slots = good.slots + 1;
+  CHECK(throws<runtime_error>(attach));
+  header->slots = UINT32_MAX;
+  header->slot_size = UINT64_MAX / 2;
+  CHECK(throws<runtime_error>(attach));
+  restore();
+
+  // frames overlapping the header
+  header->frames_offset = 0;
+  CHECK(throws<runtime_error>(attach));
+  restore();
+
+  header->stages = FRAME_RING_MAX_STAGES + 1;
+  CHECK(throws<runtime_error>(attach));
+  restore();
+
+  // chroma reports the rejected header, and a missing ring, through its exit status
+  if (!chroma.empty()) {
+    header->slots = good.slots + 1;
+    int status = run_chroma(chroma, name);
+    CHECK(status > 0 && status != 127);
+    restore();
+
+    status = run_chroma(chroma, name + "_missing");
+    CHECK(status > 0 && status != 127);
+  }
+
+  // stages out of range
+  ring_lib::frame_ring attached = ring_lib::frame_ring::attach(name);
+  ring_lib::frame_slot_header* slot;
+  CHECK(attached.stages() == 2);
+  CHECK(throws<out_of_range>([&]() { attached.try_acquire(2, slot); }));
+  CHECK(throws<out_of_range>([&]() { attached.acquire(2, slot); }));
+  CHECK(throws<out_of_range>([&]() { attached.release(2); }));
+  CHECK(throws<out_of_range>([&]() { attached.close(2); }));
+
+  // the checked geometry is kept even if the header changes afterwards
+  header->slots = UINT32_MAX;
+  CHECK(attached.slots() == good.slots);
+  CHECK(attached.try_acquire(0, slot) != nullptr);
+  restore();
+
+  munmap(memory, sizeof(ring_lib::frame_ring_header));
+
+  return check_report("frame ring");
+}
@@ -0,0 +1,36 @@
+# run_dist_roundtrip.cmake
+# Description: Keys one foreground / background pair directly while saving its
+# distance map, keys it again from the saved map and checks that both outputs
+# are identical.
+#
+# Expects CHROMA, FG, BG, KEY ("R G B"), T, DIST (*.png or raw) and OUTPUT.
+
+separate_arguments(KEY)
+
+file(REMOVE ${DIST} ${OUTPUT}_direct.png ${OUTPUT}_loaded.png)
+
+execute_process(
+  COMMAND ${CHROMA} --fg ${FG} --bg ${BG} --key-color ${KEY} --t ${T}
+          --save-dist ${DIST} --o ${OUTPUT}_direct.png
+  RESULT_VARIABLE chroma_result
+)
+if(NOT chroma_result EQUAL 0 OR NOT EXISTS ${DIST})
+  message(FATAL_ERROR "chroma failed to save ${DIST}")
+endif()
+
+execute_process(
+  COMMAND ${CHROMA} --fg ${FG} --bg ${BG} --load-dist ${DIST} --t ${T}
+          --o ${OUTPUT}_loaded.png
+  RESULT_VARIABLE chroma_result
+)
+if(NOT chroma_result EQUAL 0)
+  message(FATAL_ERROR "chroma failed to load ${DIST}")
+endif()
+
+execute_process(
+  COMMAND ${CMAKE_COMMAND} -E compare_files ${OUTPUT}_direct.png ${OUTPUT}_loaded.png
+  RESULT_VARIABLE compare_result
+)
+if(NOT compare_result EQUAL 0)
+  message(FATAL_ERROR "keying from ${DIST} differs from direct keying")
+endif()
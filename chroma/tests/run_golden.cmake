@@ -0,0 +1,39 @@
+# run_golden.cmake
+# Description: Runs chroma on one foreground / background pair and checks the
+# output against the golden key decision of the foreground.
+#
+# Expects CHROMA, GOLDEN_CHECK, FG, BG, KEY ("R G B" or "auto"), T, GOLDEN and
+# OUTPUT; MAX_DIFF (% of differing pixels allowed) defaults to 0. With
+# MODE=matte, chroma runs without BG and its matte is checked instead.
+
+separate_arguments(KEY)
+
+if(NOT DEFINED MAX_DIFF)
+  set(MAX_DIFF 0)
+endif()
+
+file(REMOVE ${OUTPUT})
+
+if(MODE STREQUAL "matte")
+  set(chroma_args --output-mode matte)
+  set(check_args --matte)
+else()
+  set(chroma_args --bg ${BG})
+  set(check_args --bg ${BG} --max-diff ${MAX_DIFF})
+endif()
+
+execute_process(
+  COMMAND ${CHROMA} --fg ${FG} ${chroma_args} --key-color ${KEY} --t ${T} --o ${OUTPUT}
+  RESULT_VARIABLE chroma_result
+)
+if(NOT chroma_result EQUAL 0 OR NOT EXISTS ${OUTPUT})
+  message(FATAL_ERROR "chroma failed on ${FG} / ${BG}")
+endif()
+
+execute_process(
+  COMMAND ${GOLDEN_CHECK} --fg ${FG} --golden ${GOLDEN} --output ${OUTPUT} ${check_args}
+  RESULT_VARIABLE check_result
+)
+if(NOT check_result EQUAL 0)
+  message(FATAL_ERROR "${OUTPUT} differs from ${GOLDEN}")
+endif()